@@ -1,6 +1,8 @@
 #ifndef ATA_DATATYPE
 #define ATA_DATATYPE
 
+#include "NDMeshStreamer.h"
+
 #define DATA_ITEM_SIZE 32
 
 struct DataItem {
@@ -9,4 +11,40 @@ public:
 };
 PUPbytes(DataItem)
 
+template <>
+struct is_PUPbytes<DataItem> {
+  static const bool value = true;
+};
+
+// An increment of a histogram bin
+struct BinUpdate {
+  CmiUInt8 bin;
+  CmiUInt8 count;
+};
+PUPbytes(BinUpdate)
+
+template <>
+struct is_PUPbytes<BinUpdate> {
+  static const bool value = true;
+};
+
+// The same, with increments of the same bin merged along the way
+struct CombinedBinUpdate : public BinUpdate {
+};
+PUPbytes(CombinedBinUpdate)
+
+template <>
+struct is_PUPbytes<CombinedBinUpdate> {
+  static const bool value = true;
+};
+
+template <>
+struct TramCombiner<CombinedBinUpdate> {
+  static const bool enabled = true;
+  static CmiUInt8 key(const CombinedBinUpdate &u) { return u.bin; }
+  static void combine(CombinedBinUpdate &acc, const CombinedBinUpdate &u) {
+    acc.count += u.count;
+  }
+};
+
 #endif
@@ -27,6 +27,10 @@ class TestController: public CBase_TestController
         std::vector<CProxySection_MyChareArray> arraySections;
         /// Counter for tracking the comm mechanism that is currently being tested
         CommMechanism curCommType;
+        /// The last comm mechanism to test
+        CommMechanism lastCommType;
+        /// Is the next loop the first one of the run (which is not timed)
+        bool isFirstLoop = true;
         /// Counters for tracking test progress
         int curMsgSize,curRepeatNum;
         /// Stream holding all the results
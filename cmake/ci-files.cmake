@@ -12,6 +12,10 @@ foreach(in_f ${ci-files})
         set(ci-output CkDummy.decl.h)
     elseif(${in_f} MATCHES src/libs/ck-libs/io/ckio.ci)
         set(ci-output CkIO.decl.h)
+    elseif(${in_f} MATCHES src/libs/ck-libs/allreduce/ckallreduce.ci)
+        set(ci-output CkAllreduce.decl.h)
+    elseif(${in_f} MATCHES src/libs/ck-libs/persistentreduction/ckpersistentreduction.ci)
+        set(ci-output CkPersistentReduction.decl.h)
     elseif(${in_f} MATCHES src/ck-core/ckreduction.ci)
         set(ci-output CkReduction.decl.h)
     elseif(${in_f} MATCHES src/ck-core/cklocation.ci)
@@ -2,6 +2,7 @@
 # conv-core
 set(conv-core-h-sources
     src/util/cmitls.h
+    src/conv-core/cmimsgpool.h
     src/conv-core/cmipool.h
     src/conv-core/cmishmem.h
     src/conv-core/cmidemangle.h
@@ -24,6 +25,7 @@ set(conv-core-h-sources
     src/conv-core/mem-arena.h
     src/conv-core/memory-gnu-threads.h
     src/conv-core/memory-isomalloc.h
+    src/conv-core/mpmcring.h
     src/conv-core/msgq.h
     src/conv-core/persistent.h
     src/conv-core/queueing.h
@@ -32,6 +34,7 @@ set(conv-core-h-sources
 )
 
 set(conv-core-cxx-sources
+    src/conv-core/cmimsgpool.C
     src/conv-core/cmipool.C
     src/conv-core/conv-conds.C
     src/conv-core/conv-rdma.C
@@ -116,6 +116,12 @@ typename std::iterator_traits<T>::value_type accumulate(T first, T last)
 int main() {}
 " CMK_HAS_ITERATOR_TRAITS)
 
+check_cxx_source_compiles("
+__attribute__((target_clones(\"default\", \"avx2\", \"avx512f\")))
+void add(int n, double *a, const double *b) { for (int i = 0; i < n; i++) a[i] += b[i]; }
+int main() { double a = 0.0, b = 1.0; add(1, &a, &b); return (int)a - 1; }
+" CMK_HAS_ATTRIBUTE_TARGET_CLONES)
+
 check_cxx_source_compiles("
 #include <list>
 #include <iterator>
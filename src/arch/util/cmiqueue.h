@@ -5,12 +5,14 @@
 #define CMIQueue LRTSQueue 
 #define CMIQueuePush    LRTSQueuePush
 #define CMIQueueCreate  LRTSQueueCreate
+#define CMIQueueCreateLockless LRTSQueueCreate
 #define CMIQueuePop     LRTSQueuePop
 #define CMIQueueEmpty   LRTSQueueEmpty
 #else
 #define CMIQueue PCQueue
 #define CMIQueuePush    PCQueuePush
 #define CMIQueueCreate  PCQueueCreate
+#define CMIQueueCreateLockless PCQueueCreateLockless
 #define CMIQueuePop     PCQueuePop
 #define CMIQueueEmpty   PCQueueEmpty
 #endif
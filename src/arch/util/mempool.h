@@ -140,6 +140,33 @@ void mempool_free(mempool_type* mptr, void* ptr_free);
 void mempool_free_thread(void* ptr_free);
 #endif
 
+// Block allocator for layers that do not need registered memory: blocks
+// are mmap'd, backed by huge pages when requested and available, and
+// bound to the NUMA node of the calling PE. Pass these to mempool_init,
+// or use mempool_init_hugepage, from the thread that owns the pool.
+void* mempool_hugepage_newblock(size_t* size, mem_handle_t* mem_hndl, int expand_flag);
+void mempool_hugepage_freeblock(void* ptr, mem_handle_t mem_hndl);
+mempool_type* mempool_init_hugepage(size_t pool_size, size_t limit);
+// Parse +mempoolHugepages, +mempoolNoNuma and +mempoolStats; called on
+// every PE at startup and exit
+void mempool_hugepage_init(char** argv);
+void mempool_hugepage_exit(void);
+
+typedef struct mempool_hugepage_stats_
+{
+  size_t blocks;          // blocks currently mapped
+  size_t bytes;           // bytes currently mapped
+  size_t hugetlb_blocks;  // mapped from explicit 2MB/1GB pages
+  size_t thp_blocks;      // mapped 2MB-aligned with transparent huge pages requested
+  size_t fallbacks;       // blocks that could not get the requested page size
+  size_t numa_bound;      // blocks bound to the owning PE's NUMA node
+  size_t numa_failed;     // blocks whose NUMA binding was refused or unknown
+} mempool_hugepage_stats;
+
+// Process-wide counters of the allocator above, totalled since startup
+// except for blocks and bytes
+void mempool_hugepage_get_stats(mempool_hugepage_stats* stats);
+
 #if defined(__cplusplus)
 }
 #endif
@@ -64,679 +64,720 @@ using PCQueue_CmiMemoryAtomicInt = std::atomic<int>;
 #define PCQueue_CmiMemoryAtomicStore(k, v, mem)  std::atomic_store_explicit(&(k), (v), (mem))
 #endif
 
-#define PCQueueSize 0x100
+#if CMK_SMP || CMK_LOCKLESS_QUEUE
 
-/**
- * The simple version of pcqueue has dropped the function of being
- * expanded if the queue is full. On one hand, each operation becomes simpler
- * and has fewer memory accesses. On the other hand, the simple pcqueue
- * is only for experimental usage.
+/*
+ * MPSC Queue Design - Justin Miron
+ *
+ * MPSCQueue-Block
+ *   _         DataNodes
+ *  |_|->N       _
+ *  |1|-------->|_|
+ *  |2|-------| |1|
+ *  |_|->N    | |2|
+ *  |_|->N    |  _
+ *  |_|->N    ->|3|
+ *              |4|
+ *              |_|
+ *
+ * The queue is designed as a multi level array. This allows us to achieve higher memory bound for a minimal space requirement.
+ * It is composed of two blocks the single array of DataNodes and a DataNode is an array of char *.
+ *
+ * MPSCQueue-Blocks --> DataNode --> char *
+ *
+ * Memory Allocation: The first push in a DataNode takes a node from the free node pool, or allocates one if the pool is empty.
+ * Memory Reclamation: The pop of the last element in a DataNode returns the node to the pool. The pool holds at most
+ * FreeNodePoolSize nodes and frees any beyond that, so a queue never holds more than MaxDataNodes + FreeNodePoolSize nodes.
+ *
+ * Ordering: Producers publish each element with a release store and the consumer reads it with an acquire load, so
+ * the contents of a message written before the push are visible to the consumer on weakly ordered machines (ARM, POWER).
+ * A DataNode is unlinked before the pull index moves past it, so a producer that has waited out QueueFull never finds
+ * a stale node in its slot.
+ *
+ * Besides CMK_LOCKLESS_QUEUE builds, SMP builds use this queue for the PE receive queues when run with +locklessRecvQueue
+ * (see PCQueueCreateLockless).
  */
-#if !USE_SIMPLE_PCQUEUE
 
-typedef struct CircQueueStruct
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <sched.h>
+#include <atomic>
+
+typedef std::atomic<char *> *DataNode; //Data nodes are an array of char *
+
+// Queue parameters initialized in ConverseInit (+MessageQueueNodes, +MessageQueueNodeSize)
+extern int DataNodeSize;
+extern int MaxDataNodes;
+extern int QueueUpperBound;
+extern int DataNodeWrap;
+extern int QueueWrap;
+extern CmiMemoryAtomicInt messageQueueOverflow;
+
+/* Queue Parameters - All must be 2^n for wrapping to work */
+#define NodePoolSize 0x100
+#define FreeNodeWrap (NodePoolSize - 1)
+
+/* The MPSC pool only has to cover the nodes in transit between the consumer and the producers */
+#define FreeNodePoolSize 0x10
+#define FreeNodePoolWrap (FreeNodePoolSize - 1)
+
+static inline void ReportOverflow()
 {
-  struct CircQueueStruct * CMK_SMP_volatile next;
-  CmiMemoryAtomicInt push;
-  CMK_SMP_align int pull;
-#if CMK_SMP
-  CMK_SMP_align std::atomic<char *> data[PCQueueSize];
-#else
-  char *data[PCQueueSize];
-#endif
+  CmiMemoryAtomicIncrement(messageQueueOverflow);
 }
-*CircQueue;
 
-typedef struct PCQueueStruct
+/*
+ * FreeNodePoolStruct
+ * Holds nodes that are no longer in use but are not being freed
+ * Acts as a SPMC bounded queue: the consumer of the MPSCQueue returns nodes, its producers take them
+ * push and pull are free-running counters, so a stalled producer cannot be fooled by the pool wrapping around
+ */
+typedef struct FreeNodePoolStruct
 {
-  CircQueue head;
-  CMK_SMP_align CircQueue CMK_SMP_volatile tail;
-  CMK_SMP_align PCQueue_CmiMemoryAtomicInt len;
-#if CMK_PCQUEUE_LOCK || CMK_PCQUEUE_PUSH_LOCK
-  CmiNodeLock  lock;
-#endif
+  std::atomic<unsigned int> push;
+  alignas(CMI_CACHE_LINE_SIZE) std::atomic<unsigned int> pull;
+  alignas(CMI_CACHE_LINE_SIZE) std::atomic<DataNode> nodes[FreeNodePoolSize];
+} *FreeNodePool;
+
+/*
+ * MPSCQueueStruct
+ * Linked list of queues that adds new node when DataNodeStruct is full
+ * Insert at tail_node->push and remove at head_node->pull
+ */
+typedef struct MPSCQueueStruct
+{
+  std::atomic<unsigned int> push;
+  alignas(CMI_CACHE_LINE_SIZE) std::atomic<unsigned int> pull;
+  alignas(CMI_CACHE_LINE_SIZE) std::atomic<DataNode> *nodes;
+  FreeNodePool freeNodePool;
+} *MPSCQueue;
+
+static inline unsigned int WrappedDifference(unsigned int push, unsigned int pull)
+{
+  // Unsigned arithmetic already wraps around UINT_MAX correctly
+  return push - pull;
 }
-*PCQueue;
 
-static PCQueue PCQueueCreate(void)
+static int QueueFull(unsigned int push, unsigned int pull)
 {
-  CircQueue circ;
-  PCQueue Q;
+  int difference = WrappedDifference(push, pull);
 
-  circ = (CircQueue)calloc(1, sizeof(struct CircQueueStruct));
-  Q = (PCQueue)malloc(sizeof(struct PCQueueStruct));
-  _MEMCHECK(Q);
-  Q->head = circ;
-  Q->tail = circ;
-  Q->len = 0;
-#if CMK_PCQUEUE_LOCK || CMK_PCQUEUE_PUSH_LOCK
-  Q->lock = CmiCreateLock();
-#endif
-  return Q;
+  // The use of QueueUpperBound - 2*DataNodeSize is to remove the possiblity of wrapping
+  // around the entire queue and pushing to a block that is going to be freed.
+  // This removes concurrency issues with wrapping the entire queue and pushing to a block that
+  // is being popped.
+  if(difference >= (QueueUpperBound - 2*DataNodeSize))
+    return 1;
+  else
+    return 0;
 }
 
-static void PCQueueDestroy(PCQueue Q)
+/* Creates a DataNode while holds the char* to data */
+static DataNode DataNodeCreate(void)
 {
-  CircQueue circ = Q->head;
-  while (circ != Q->tail) {
-    free(circ);
-    circ = circ->next;
-  }
-  free(circ);
-  free(Q);
+  DataNode node = (DataNode)malloc(sizeof(std::atomic<char *>)*DataNodeSize);
+  _MEMCHECK(node);
+  int i;
+  for(i = 0; i < DataNodeSize; ++i) std::atomic_store_explicit(&node[i], (char *)NULL, std::memory_order_relaxed);
+  return node;
 }
 
-static int PCQueueEmpty(PCQueue Q)
+/* Initialize the FreeNodePool as a SPMC queue */
+static FreeNodePool FreeNodePoolCreate(void)
 {
-  return (PCQueue_CmiMemoryAtomicLoad(Q->len, std::memory_order_acquire) == 0);
+  FreeNodePool free_q;
+
+  free_q = (FreeNodePool)CmiAlignedAlloc(CMI_CACHE_LINE_SIZE, sizeof(struct FreeNodePoolStruct));
+  _MEMCHECK(free_q);
+  std::atomic_store_explicit(&free_q->push, 0u, std::memory_order_relaxed);
+  std::atomic_store_explicit(&free_q->pull, 0u, std::memory_order_relaxed);
+
+  int i;
+  for(i = 0; i < FreeNodePoolSize; ++i)
+    std::atomic_store_explicit(&free_q->nodes[i], (DataNode)NULL, std::memory_order_relaxed);
+
+  return free_q;
 }
 
-static int PCQueueLength(PCQueue Q)
+/* Clean up all data on the queue */
+static void FreeNodePoolDestroy(FreeNodePool q)
 {
-  return PCQueue_CmiMemoryAtomicLoad(Q->len, std::memory_order_acquire);
+  int i;
+  for(i = 0; i < FreeNodePoolSize; ++i)
+  {
+    DataNode n = std::atomic_load_explicit(&q->nodes[i], std::memory_order_acquire);
+    if(n != NULL)
+      free(n);
+  }
+  CmiAlignedFree(q);
 }
 
-static char *PCQueueTop(PCQueue Q)
+/* Called by producers */
+static DataNode get_free_node(FreeNodePool q)
 {
-  CircQueue circ; int pull; char *data;
+  unsigned int pull = std::atomic_load_explicit(&q->pull, std::memory_order_relaxed);
 
-    if (PCQueue_CmiMemoryAtomicLoad(Q->len, std::memory_order_relaxed) == 0) return 0;
-#if CMK_PCQUEUE_LOCK
-    CmiLock(Q->lock);
-#endif
-    circ = Q->head;
-    pull = circ->pull;
-    data = PCQueue_CmiMemoryAtomicLoad(circ->data[pull], std::memory_order_acquire);
+  // Claim the next unique pull value if the pool is not empty
+  do
+  {
+    if(std::atomic_load_explicit(&q->push, std::memory_order_acquire) == pull) // Pool is empty, need to allocate a new DataNode.
+      return DataNodeCreate();
 
-#if CMK_PCQUEUE_LOCK
-      CmiUnlock(Q->lock);
-#endif
-      return data;
+  } while(!std::atomic_compare_exchange_weak_explicit(&q->pull, &pull, pull + 1, std::memory_order_acquire, std::memory_order_relaxed));
+
+  // The slot was filled before push moved past it. NULL it out to hand the slot back to the consumer.
+  return std::atomic_exchange_explicit(&q->nodes[pull & FreeNodePoolWrap], (DataNode)NULL, std::memory_order_acquire);
 }
 
+/* Called by the consumer only */
+static void add_free_node(FreeNodePool q, DataNode available)
+{
+  unsigned int push = std::atomic_load_explicit(&q->push, std::memory_order_relaxed);
+  unsigned int pull = std::atomic_load_explicit(&q->pull, std::memory_order_relaxed);
+
+  // The pool is full, or a producer has claimed the slot but not yet taken its node
+  if(push - pull >= FreeNodePoolSize ||
+     std::atomic_load_explicit(&q->nodes[push & FreeNodePoolWrap], std::memory_order_acquire) != NULL)
+  {
+    free(available);
+    return;
+  }
+
+  std::atomic_store_explicit(&q->nodes[push & FreeNodePoolWrap], available, std::memory_order_relaxed);
+  std::atomic_store_explicit(&q->push, push + 1, std::memory_order_release);
+}
 
-static char *PCQueuePop(PCQueue Q)
+static MPSCQueue MPSCQueueCreate(void)
 {
-  CircQueue circ; int pull; char *data;
+  /* Initialize the MPSCQueue struct */
+  MPSCQueue Q = (MPSCQueue)CmiAlignedAlloc(CMI_CACHE_LINE_SIZE, sizeof(struct MPSCQueueStruct));
+  _MEMCHECK(Q);
+  Q->nodes = (std::atomic<DataNode>*)malloc(sizeof(std::atomic<DataNode>)*MaxDataNodes);
+  _MEMCHECK(Q->nodes);
+  Q->freeNodePool = FreeNodePoolCreate();
+  std::atomic_store_explicit(&Q->pull, 0u, std::memory_order_relaxed);
+  std::atomic_store_explicit(&Q->push, 0u, std::memory_order_relaxed);
 
-    if (PCQueue_CmiMemoryAtomicLoad(Q->len, std::memory_order_relaxed) == 0) return 0;
-#if CMK_PCQUEUE_LOCK
-    CmiLock(Q->lock);
-#endif
-    circ = Q->head;
-    pull = circ->pull;
-    data = PCQueue_CmiMemoryAtomicLoad(circ->data[pull], std::memory_order_acquire);
+  unsigned int i;
+  for(i = 0; i < MaxDataNodes; ++i)
+  {
+    std::atomic_store_explicit(&Q->nodes[i], (DataNode)NULL, std::memory_order_relaxed);
+  }
 
+  return Q;
+}
 
-    if (data) {
-      circ->pull = (pull + 1);
-      circ->data[pull] = 0;
-      if (pull == PCQueueSize - 1) { /* just pulled the data from the last slot
-                                     of this buffer */
-        PCQueue_CmiMemoryReadFence();
-        /*while (circ->next == 0);   This instruciton does not seem needed... but it might */
-        Q->head = circ-> next; /* next buffer must exist, because "Push"  */
-        CmiAssert(Q->head != NULL);
+static void MPSCQueueDestroy(MPSCQueue Q)
+{
+  /* Iterate through blocks. Every Datanode in the array must be freed before the node array */
+  unsigned int i;
+  for(i = 0; i < MaxDataNodes; ++i)
+  {
+    DataNode n = std::atomic_load_explicit(&Q->nodes[i], std::memory_order_acquire);
+    if(n != NULL)
+      free(n);
+  }
 
-        free(circ);
+  FreeNodePoolDestroy(Q->freeNodePool);
+  free(Q->nodes);
+  CmiAlignedFree(Q);
+}
 
-	/* links in the next buffer *before* filling */
-                               /* in the last slot. See below. */
-      }
-      PCQueue_CmiMemoryAtomicDecrement(Q->len, std::memory_order_release);
-#if CMK_PCQUEUE_LOCK
-      CmiUnlock(Q->lock);
-#endif
-      return data;
-    }
-    else { /* queue seems to be empty. The producer may be adding something
-              to it, but its ok to report queue is empty. */
-#if CMK_PCQUEUE_LOCK
-      CmiUnlock(Q->lock);
-#endif
-      return 0;
-    }
+/* Index of DataNode in the node array */
+static inline unsigned int get_node_index(unsigned int value)
+{
+  return ((value & QueueWrap) / DataNodeSize);
 }
 
-static void PCQueuePush(PCQueue Q, char *data)
+/* Gets the DataNode to push to */
+static DataNode get_push_node(MPSCQueue Q, unsigned int push_idx)
 {
-  CircQueue circ, circ1; int push;
+  /* Index in the block: block[block_idx] */
+  unsigned int node_idx = get_node_index(push_idx);
 
-#if CMK_PCQUEUE_LOCK|| CMK_PCQUEUE_PUSH_LOCK
-  CmiLock(Q->lock);
-#endif
-  circ1 = Q->tail;
-#ifdef PCQUEUE_MULTIQUEUE
-  CmiMemoryAtomicFetchAndInc(circ1->push, push);
-#else
-  push = circ1->push;
-  circ1->push = (push + 1);
-#endif
-#ifdef PCQUEUE_MULTIQUEUE
-  while (push >= PCQueueSize) {
-    /* this circqueue is full, and we need to wait for the thread writing
- *        the last slot to allocate the new queue */
-    PCQueue_CmiMemoryReadFence();
-    while (Q->tail == circ1);
-    circ1 = Q->tail;
-    CmiMemoryAtomicFetchAndInc(circ1->push, push);
+  /* If it is the first in the DataNode then create the node otherwise wait for it */
+  if((push_idx & DataNodeWrap) == 0)
+  {
+    DataNode new_node = get_free_node(Q->freeNodePool);
+    std::atomic_store_explicit(&Q->nodes[node_idx], new_node, std::memory_order_release);
+    return new_node;
   }
-#endif
+  else // Wait until the producer with the first element in the DataNode creates the node.
+  {
+    DataNode node;
+    while((node = std::atomic_load_explicit(&Q->nodes[node_idx], std::memory_order_acquire)) == NULL);
+    return node;
+  }
+}
 
-  if (push == (PCQueueSize -1)) { /* last slot is about to be filled */
-    /* this way, the next buffer is linked in before data is filled in
-       in the last slot of this buffer */
+/* Get index of pop node in the popped block */
+static inline DataNode get_pop_node(MPSCQueue Q, unsigned int pull_idx)
+{
+  unsigned int node_idx = get_node_index(pull_idx);
 
-    circ = (CircQueue)calloc(1, sizeof(struct CircQueueStruct));
+  return std::atomic_load_explicit(&Q->nodes[node_idx], std::memory_order_acquire);
+}
 
-#ifdef PCQUEUE_MULTIQUEUE
-    PCQueue_CmiMemoryWriteFence();
-#endif
+/* Check whether or not a node is ready to be recycled. Must run before pull is advanced. */
+static void check_mem_reclamation(MPSCQueue Q, unsigned int pull_idx, DataNode node)
+{
+  unsigned int node_idx = get_node_index(pull_idx);
 
-    Q->tail->next = circ;
-    Q->tail = circ;
+  /* If we are pulling from the end of a node, unlink it and hand it back to the pool */
+  if((pull_idx & DataNodeWrap) == (DataNodeSize - 1))
+  {
+    std::atomic_store_explicit(&Q->nodes[node_idx], (DataNode)NULL, std::memory_order_relaxed);
+    add_free_node(Q->freeNodePool, node);
   }
+}
 
-  PCQueue_CmiMemoryAtomicStore(circ1->data[push], data, std::memory_order_release);
-  PCQueue_CmiMemoryAtomicIncrement(Q->len, std::memory_order_relaxed);
+static int MPSCQueueEmpty(MPSCQueue Q)
+{
+  unsigned int push = std::atomic_load_explicit(&Q->push, std::memory_order_relaxed);
+  unsigned int pull = std::atomic_load_explicit(&Q->pull, std::memory_order_relaxed);
+  return WrappedDifference(push, pull) == 0;
+}
 
-#if CMK_PCQUEUE_LOCK || CMK_PCQUEUE_PUSH_LOCK
-  CmiUnlock(Q->lock);
-#endif
+static int MPSCQueueLength(MPSCQueue Q)
+{
+  unsigned int push = std::atomic_load_explicit(&Q->push, std::memory_order_relaxed);
+  unsigned int pull = std::atomic_load_explicit(&Q->pull, std::memory_order_relaxed);
+  return (int)WrappedDifference(push, pull);
 }
 
-#else
+static char *MPSCQueueTop(MPSCQueue Q)
+{
+  unsigned int pull = std::atomic_load_explicit(&Q->pull, std::memory_order_relaxed);
+
+  DataNode node = get_pop_node(Q, pull);
+  if(node == NULL) return NULL; // Queue is empty, or the block is not linked in yet
+
+  return std::atomic_load_explicit(&node[pull & DataNodeWrap], std::memory_order_acquire);
+}
+
+/* Called by the consumer only. Does not read push, so it stays off the producers' cache line. */
+static char *MPSCQueuePop(MPSCQueue Q)
+{
+  unsigned int pull = std::atomic_load_explicit(&Q->pull, std::memory_order_relaxed);
+
+  DataNode node = get_pop_node(Q, pull);
+  if(node == NULL) // Queue is empty, or a producer has not finished allocating the block we are attempting to pop from
+    return NULL;
+
+  unsigned int node_pull = pull & DataNodeWrap;
+
+  char * data = std::atomic_load_explicit(&node[node_pull], std::memory_order_acquire);
+  if(data == NULL) // Queue is empty, or a producer has not finished pushing the element we are attempting to pop
+    return NULL;
+
+  std::atomic_store_explicit(&node[node_pull], (char *)NULL, std::memory_order_relaxed); //NULL the element to indicate it is available again
+
+  check_mem_reclamation(Q, pull, node); //Check if we can recycle the node
+
+  std::atomic_store_explicit(&Q->pull, pull + 1, std::memory_order_release);
+
+  return data;
+}
+
+static void MPSCQueuePush(MPSCQueue Q, char *data)
+{
+  unsigned int push = std::atomic_fetch_add_explicit(&Q->push, 1u, std::memory_order_relaxed);
+
+  if(QueueFull(push, std::atomic_load_explicit(&Q->pull, std::memory_order_acquire)))
+  {
+    ReportOverflow();
+    do //Block until the push index is available to push to
+    {
+      sched_yield();
+    } while(QueueFull(push, std::atomic_load_explicit(&Q->pull, std::memory_order_acquire)));
+  }
+
+  DataNode node = get_push_node(Q, push);
+  std::atomic_store_explicit(&node[push & DataNodeWrap], data, std::memory_order_release);
+}
+
+#endif /* CMK_SMP || CMK_LOCKLESS_QUEUE */
+
+#define PCQueueSize 0x100
 
 /**
- * The beginning of definitions for simple pcqueue
+ * The simple version of pcqueue has dropped the function of being
+ * expanded if the queue is full. On one hand, each operation becomes simpler
+ * and has fewer memory accesses. On the other hand, the simple pcqueue
+ * is only for experimental usage.
  */
-typedef struct PCQueueStruct
-{
-  char **head; /*pointing to the first element*/
+#if !USE_SIMPLE_PCQUEUE
 
-  //CMK_SMP_align char** CMK_SMP_volatile tail; /*pointing to the last element*/
-  CMK_SMP_align char** tail; /*pointing to the last element*/
+typedef struct CircQueueStruct
+{
+  struct CircQueueStruct * CMK_SMP_volatile next;
+  CmiMemoryAtomicInt push;
+  CMK_SMP_align int pull;
+#if CMK_SMP
+  CMK_SMP_align std::atomic<char *> data[PCQueueSize];
+#else
+  char *data[PCQueueSize];
+#endif
+}
+*CircQueue;
 
+typedef struct PCQueueStruct
+{
+  CircQueue head;
+  CMK_SMP_align CircQueue CMK_SMP_volatile tail;
   CMK_SMP_align PCQueue_CmiMemoryAtomicInt len;
-  CMK_SMP_align const char **data;
-  const char **bufEnd;
-
-#if CMK_PCQUEUE_LOCK
+#if CMK_PCQUEUE_LOCK || CMK_PCQUEUE_PUSH_LOCK
   CmiNodeLock  lock;
 #endif
-
+#if CMK_SMP
+  MPSCQueue lockless; /* if set, all operations go to this queue instead */
+#endif
 }
 *PCQueue;
 
 static PCQueue PCQueueCreate(void)
 {
+  CircQueue circ;
   PCQueue Q;
 
+  circ = (CircQueue)calloc(1, sizeof(struct CircQueueStruct));
   Q = (PCQueue)malloc(sizeof(struct PCQueueStruct));
-  Q->data = (const char **)malloc(sizeof(char *)*PCQueueSize);
-  memset(Q->data, 0, sizeof(char *)*PCQueueSize);
   _MEMCHECK(Q);
-  Q->head = (char **)Q->data;
-  Q->tail = (char **)Q->data;
+  Q->head = circ;
+  Q->tail = circ;
   Q->len = 0;
-  Q->bufEnd = Q->data + PCQueueSize;
-
 #if CMK_PCQUEUE_LOCK || CMK_PCQUEUE_PUSH_LOCK
   Q->lock = CmiCreateLock();
 #endif
+#if CMK_SMP
+  Q->lockless = NULL;
+#endif
+  return Q;
+}
 
+#if CMK_SMP
+/**
+ * Create a PCQueue backed by a lock-free MPSCQueue. Any number of threads
+ * may push without taking a lock, but only one thread may pop.
+ */
+static PCQueue PCQueueCreateLockless(void)
+{
+  PCQueue Q = PCQueueCreate();
+  Q->lockless = MPSCQueueCreate();
   return Q;
 }
+#endif
 
 static void PCQueueDestroy(PCQueue Q)
 {
-  free(Q->data);
+  CircQueue circ = Q->head;
+#if CMK_SMP
+  if (Q->lockless) MPSCQueueDestroy(Q->lockless);
+#endif
+  while (circ != Q->tail) {
+    free(circ);
+    circ = circ->next;
+  }
+  free(circ);
   free(Q);
 }
 
 static int PCQueueEmpty(PCQueue Q)
 {
+#if CMK_SMP
+  if (Q->lockless) return MPSCQueueEmpty(Q->lockless);
+#endif
   return (PCQueue_CmiMemoryAtomicLoad(Q->len, std::memory_order_acquire) == 0);
 }
 
 static int PCQueueLength(PCQueue Q)
 {
+#if CMK_SMP
+  if (Q->lockless) return MPSCQueueLength(Q->lockless);
+#endif
   return PCQueue_CmiMemoryAtomicLoad(Q->len, std::memory_order_acquire);
 }
+
 static char *PCQueueTop(PCQueue Q)
 {
+  CircQueue circ; int pull; char *data;
 
-    char *data;
+#if CMK_SMP
+    if (Q->lockless) return MPSCQueueTop(Q->lockless);
+#endif
 
+    if (PCQueue_CmiMemoryAtomicLoad(Q->len, std::memory_order_relaxed) == 0) return 0;
 #if CMK_PCQUEUE_LOCK
     CmiLock(Q->lock);
 #endif
+    circ = Q->head;
+    pull = circ->pull;
+    data = PCQueue_CmiMemoryAtomicLoad(circ->data[pull], std::memory_order_acquire);
 
-    data = *(Q->head);
-//    if(data == 0) return 0;
-     
 #if CMK_PCQUEUE_LOCK
       CmiUnlock(Q->lock);
 #endif
-
       return data;
 }
 
+
 static char *PCQueuePop(PCQueue Q)
 {
+  CircQueue circ; int pull; char *data;
 
-    char *data;
+#if CMK_SMP
+    if (Q->lockless) return MPSCQueuePop(Q->lockless);
+#endif
 
+    if (PCQueue_CmiMemoryAtomicLoad(Q->len, std::memory_order_relaxed) == 0) return 0;
 #if CMK_PCQUEUE_LOCK
     CmiLock(Q->lock);
 #endif
+    circ = Q->head;
+    pull = circ->pull;
+    data = PCQueue_CmiMemoryAtomicLoad(circ->data[pull], std::memory_order_acquire);
 
-    data = *(Q->head);
-//    if(data == 0) return 0;
-     
-    PCQueue_CmiMemoryReadFence();    
 
-    if(data){
-      *(Q->head) = 0;
-      Q->head++;
+    if (data) {
+      circ->pull = (pull + 1);
+      circ->data[pull] = 0;
+      if (pull == PCQueueSize - 1) { /* just pulled the data from the last slot
+                                     of this buffer */
+        PCQueue_CmiMemoryReadFence();
+        /*while (circ->next == 0);   This instruciton does not seem needed... but it might */
+        Q->head = circ-> next; /* next buffer must exist, because "Push"  */
+        CmiAssert(Q->head != NULL);
 
-      if (Q->head == (char **)Q->bufEnd ) { 
-	Q->head = (char **)Q->data;
+        free(circ);
+
+	/* links in the next buffer *before* filling */
+                               /* in the last slot. See below. */
       }
       PCQueue_CmiMemoryAtomicDecrement(Q->len, std::memory_order_release);
-
-    }
-
 #if CMK_PCQUEUE_LOCK
       CmiUnlock(Q->lock);
 #endif
-
       return data;
-}
-static void PCQueuePush(PCQueue Q, char *data)
-{
-#if CMK_PCQUEUE_LOCK || CMK_PCQUEUE_PUSH_LOCK
-  CmiLock(Q->lock);
-#endif
-
-  PCQueue_CmiMemoryWriteFence();
-
-  //CmiAssert(*(Q->tail)==0);
-
-  *(Q->tail) = data;
-   Q->tail++;
-
-  if (Q->tail == (char **)Q->bufEnd) { /* last slot is about to be filled */
-    /* this way, the next buffer is linked in before data is filled in
-       in the last slot of this buffer */
-    Q->tail = (char **)Q->data;
-  }
-
-#if 0
-  if(Q->head == Q->tail && Q->len>0){ /* the whole buffer is fully occupied; len>0 is used to differentiate the case when the queue is empty in which head is also equal to tail*/
-       CmiAbort("Simple PCQueue is full!!\n");
-/*       char **newdata = (char **)malloc(sizeof(char *)*(Q->len << 1));
-       int rsize = Q->data + Q->curSize - Q->head;
-       int lsize = Q->tail - Q->data;
-       memcpy(newdata, Q->head, sizeof(char *)*rsize);
-       memcpy(newdata+rsize, Q->data, sizeof(char *)*lsize);
-       free(Q->data);
-       Q->data = newdata;
-       Q->head = newdata;
-       Q->tail = Q->data + Q->len;
-*/
-  }
-#endif
-
-  PCQueue_CmiMemoryAtomicIncrement(Q->len, std::memory_order_release);
-
-#if CMK_PCQUEUE_LOCK || CMK_PCQUEUE_PUSH_LOCK
-  CmiUnlock(Q->lock);
-#endif
-}
+    }
+    else { /* queue seems to be empty. The producer may be adding something
+              to it, but its ok to report queue is empty. */
+#if CMK_PCQUEUE_LOCK
+      CmiUnlock(Q->lock);
 #endif
-
-// CMK_LOCKLESS_QUEUE (disabled by default)
-#if CMK_LOCKLESS_QUEUE
-
-/*
- * MPSC Queue Design - Justin Miron
- *
- * MPSCQueue-Block
- *   _         DataNodes
- *  |_|->N       _
- *  |1|-------->|_|
- *  |2|-------| |1|
- *  |_|->N    | |2|
- *  |_|->N    |  _
- *  |_|->N    ->|3|
- *              |4|
- *              |_|
- *
- * The queue is designed as a multi level array. This allows us to achieve higher memory bound for a minimal space requirement.
- * It is composed of two blocks the single array of DataNodes and a DataNode is an array of char *.
- *
- * MPSCQueue-Blocks --> DataNode --> char *
- *
- * Memory Allocation: The first push in the first DataNode index of a data node allocates the node.
- * Memory Reclamation: The last push in the last DataNode frees the memory of the DataNode.
- *
- *
- */
-
-#include <stdlib.h>
-#include <stdint.h>
-#include <limits.h>
-#include <sched.h>
-
-typedef char** DataNode; //Data nodes are an array of char *
-
-// Queue parameters initialized in init.C
-extern int DataNodeSize;
-extern int MaxDataNodes;
-extern int QueueUpperBound;
-extern int DataNodeWrap;
-extern int QueueWrap;
-extern CmiMemoryAtomicInt messageQueueOverflow;
-
-/* Queue Parameters - All must be 2^n for wrapping to work */
-#define NodePoolSize 0x100
-#define FreeNodeWrap (NodePoolSize - 1)
-
-void ReportOverflow()
-{
-  CmiMemoryAtomicIncrement(messageQueueOverflow);
-}
-
-/*
- * FreeNodePoolStruct
- * Holds nodes that are no longer in use but are not being freed
- * Acts as a SPSC bounded queue
- */
-typedef struct FreeNodePoolStruct
-{
-  std::atomic<unsigned int> push;
-  std::atomic<unsigned int> pull;
-  std::atomic<uintptr_t> nodes[NodePoolSize];
-} *FreeNodePool;
-
-/*
- * MPSCQueueStruct
- * Linked list of queues that adds new node when DataNodeStruct is full
- * Insert at tail_node->push and remove at head_node->pull
- */
-typedef struct MPSCQueueStruct
-{
-  std::atomic<unsigned int> push;
-  alignas(CMI_CACHE_LINE_SIZE) unsigned int pull;
-  alignas(CMI_CACHE_LINE_SIZE) std::atomic<uintptr_t> *nodes;
-  alignas(CMI_CACHE_LINE_SIZE) FreeNodePool freeNodePool;
-} *MPSCQueue;
-
-static unsigned int WrappedDifference(unsigned int push, unsigned int pull)
-{
-  unsigned int difference;
-  if(push < pull)
-  {
-    difference = (UINT_MAX - pull + push);
-  }
-  else
-  {
-    difference = push - pull;
-  }
-  return difference;
-}
-
-static int QueueFull(unsigned int push, unsigned int pull)
-{
-  int difference = WrappedDifference(push, pull);
-
-  // The use of QueueUpperBound - 2*DataNodeSize is to remove the possiblity of wrapping
-  // around the entire queue and pushing to a block that is going to be freed.
-  // This removes concurrency issues with wrapping the entire queue and pushing to a block that
-  // is being popped.
-  if(difference >= (QueueUpperBound - 2*DataNodeSize))
-    return 1;
-  else
-    return 0;
-}
-
-/* Creates a DataNode while holds the char* to data */
-static DataNode DataNodeCreate(void)
-{
-  DataNode node = (DataNode)malloc(sizeof(char*)*DataNodeSize);
-  int i;
-  for(i = 0; i < DataNodeSize; ++i) node[i] = NULL;
-  return node;
-}
-
-/* Initialize the FreeNodePool as a SPSC queue */
-static FreeNodePool FreeNodePoolCreate(void)
-{
-  FreeNodePool free_q;
-
-  free_q = (FreeNodePool)malloc(sizeof(struct FreeNodePoolStruct));
-  std::atomic_store_explicit(&free_q->push, 0u, std::memory_order_relaxed);
-  std::atomic_store_explicit(&free_q->pull, 0u, std::memory_order_relaxed);
-
-  int i;
-  for(i = 0; i < NodePoolSize; ++i)
-    std::atomic_store_explicit(&free_q->nodes[i], (uintptr_t)NULL, std::memory_order_relaxed);
-
-  return free_q;
-}
-
-/* Clean up all data on the queue */
-static void FreeNodePoolDestroy(FreeNodePool q)
-{
-  int i;
-  for(i = 0; i < NodePoolSize; ++i)
-  {
-    if((uintptr_t)atomic_load_explicit(&q->nodes[i], std::memory_order_acquire) != (uintptr_t)NULL)
-    {
-      DataNode n = (DataNode)atomic_load_explicit(&q->nodes[i], std::memory_order_acquire);
-      free(n);
+      return 0;
     }
-  }
-  free(q);
 }
 
-static DataNode get_free_node(FreeNodePool q)
+static void PCQueuePush(PCQueue Q, char *data)
 {
-  DataNode node;
-  unsigned int push;
-  unsigned int pull = std::atomic_load_explicit(&q->pull, std::memory_order_acquire);
-
-  // Claim the next unique pull value if the queue is not empty
-  do
-  {
-    push = std::atomic_load_explicit(&q->push, std::memory_order_acquire);
+  CircQueue circ, circ1; int push;
 
-    if(pull == push) // Pool is empty, need to allocate a new DataNode.
-      return DataNodeCreate();
+#if CMK_SMP
+  if (Q->lockless) { MPSCQueuePush(Q->lockless, data); return; }
+#endif
 
-  } while(!std::atomic_compare_exchange_weak_explicit(&q->pull, &pull, (pull + 1) & FreeNodeWrap, std::memory_order_release, std::memory_order_relaxed));
+#if CMK_PCQUEUE_LOCK|| CMK_PCQUEUE_PUSH_LOCK
+  CmiLock(Q->lock);
+#endif
+  circ1 = Q->tail;
+#ifdef PCQUEUE_MULTIQUEUE
+  CmiMemoryAtomicFetchAndInc(circ1->push, push);
+#else
+  push = circ1->push;
+  circ1->push = (push + 1);
+#endif
+#ifdef PCQUEUE_MULTIQUEUE
+  while (push >= PCQueueSize) {
+    /* this circqueue is full, and we need to wait for the thread writing
+ *        the last slot to allocate the new queue */
+    PCQueue_CmiMemoryReadFence();
+    while (Q->tail == circ1);
+    circ1 = Q->tail;
+    CmiMemoryAtomicFetchAndInc(circ1->push, push);
+  }
+#endif
 
-  // If the element is NULL, a producer is still pushing to the slot, but has begun the push operation.
-  while((node = (DataNode)atomic_load_explicit(&q->nodes[pull], std::memory_order_acquire)) == NULL);
-  std::atomic_store_explicit(&q->nodes[pull], (uintptr_t)NULL, std::memory_order_release); //NULL out spot in queue to indicate available spot.
+  if (push == (PCQueueSize -1)) { /* last slot is about to be filled */
+    /* this way, the next buffer is linked in before data is filled in
+       in the last slot of this buffer */
 
-  return node;
-}
+    circ = (CircQueue)calloc(1, sizeof(struct CircQueueStruct));
 
-static void add_free_node(FreeNodePool q, DataNode available)
-{
-  unsigned int pull;
-  unsigned int push = std::atomic_load_explicit(&q->push, std::memory_order_acquire);
+#ifdef PCQUEUE_MULTIQUEUE
+    PCQueue_CmiMemoryWriteFence();
+#endif
 
-  // Claim a unique push value if the queue is not empty
-  do
-  {
-    // The next push value's element has not been NULL'd yet by a consumer, indicating the queue is full
-    if((uintptr_t)atomic_load_explicit(&q->nodes[push], std::memory_order_acquire) != (uintptr_t)NULL)
-    {
-      free(available);
-      return;
-    }
+    Q->tail->next = circ;
+    Q->tail = circ;
+  }
 
-  } while(!std::atomic_compare_exchange_weak_explicit(&q->push, &push, (push + 1) & FreeNodeWrap, std::memory_order_release, std::memory_order_relaxed));
+  PCQueue_CmiMemoryAtomicStore(circ1->data[push], data, std::memory_order_release);
+  PCQueue_CmiMemoryAtomicIncrement(Q->len, std::memory_order_relaxed);
 
-  std::atomic_store_explicit(&q->nodes[push], (uintptr_t)available, std::memory_order_release);
+#if CMK_PCQUEUE_LOCK || CMK_PCQUEUE_PUSH_LOCK
+  CmiUnlock(Q->lock);
+#endif
 }
 
-static MPSCQueue MPSCQueueCreate(void)
-{
-  /* Initialize the MPSCQueue struct */
-  MPSCQueue Q = (MPSCQueue)malloc(sizeof(struct MPSCQueueStruct));
-  Q->nodes = (std::atomic<uintptr_t>*)malloc(sizeof(std::atomic<uintptr_t>)*MaxDataNodes);
-  Q->freeNodePool = FreeNodePoolCreate();
-  Q->pull = 0;
-  std::atomic_store_explicit(&Q->push, 0u, std::memory_order_relaxed);
+#else
 
-  unsigned int i;
-  for(i = 0; i < MaxDataNodes; ++i)
-  {
-    std::atomic_store_explicit(&Q->nodes[i], (uintptr_t)NULL, std::memory_order_relaxed);
-  }
+/**
+ * The beginning of definitions for simple pcqueue
+ */
+typedef struct PCQueueStruct
+{
+  char **head; /*pointing to the first element*/
 
-  return Q;
-}
+  //CMK_SMP_align char** CMK_SMP_volatile tail; /*pointing to the last element*/
+  CMK_SMP_align char** tail; /*pointing to the last element*/
 
-static void MPSCQueueDestroy(MPSCQueue Q)
-{
-  /* Iterate through blocks. Every Datanode in the array must be freed before the node array */
-  unsigned int i, j;
-  for(i = 0; i < MaxDataNodes; ++i)
-    if((uintptr_t)atomic_load_explicit(&Q->nodes[i], std::memory_order_acquire) != (uintptr_t)NULL)
-    {
-      free((DataNode)atomic_load_explicit(&Q->nodes[i], std::memory_order_acquire));
-    }
+  CMK_SMP_align PCQueue_CmiMemoryAtomicInt len;
+  CMK_SMP_align const char **data;
+  const char **bufEnd;
 
-  FreeNodePoolDestroy(Q->freeNodePool);
-  free(Q->nodes);
-  free(Q);
-}
+#if CMK_PCQUEUE_LOCK
+  CmiNodeLock  lock;
+#endif
 
-/* Index of DataNode in the node array */
-static inline unsigned int get_node_index(unsigned int value)
-{
-  return ((value & QueueWrap) / DataNodeSize);
 }
+*PCQueue;
 
-/* Gets the DataNode to push to */
-static DataNode get_push_node(MPSCQueue Q, unsigned int push_idx)
+static PCQueue PCQueueCreate(void)
 {
-  /* Index in the block: block[block_idx] */
-  unsigned int node_idx = get_node_index(push_idx);
+  PCQueue Q;
 
-  /* If it is the first in the DataNode then create the node otherwise wait for it */
-  if((push_idx & DataNodeWrap) == 0)
-  {
-    DataNode new_node = get_free_node(Q->freeNodePool);
-    std::atomic_store_explicit(&Q->nodes[node_idx], (uintptr_t)new_node, std::memory_order_release);
-    return new_node;
-  }
-  else // Wait until the producer with the first element in the DataNode creates the node.
-  {
-    DataNode node;
-    while((node = (DataNode)atomic_load_explicit(&Q->nodes[node_idx], std::memory_order_acquire)) == NULL);
-    return node;
-  }
-}
+  Q = (PCQueue)malloc(sizeof(struct PCQueueStruct));
+  Q->data = (const char **)malloc(sizeof(char *)*PCQueueSize);
+  memset(Q->data, 0, sizeof(char *)*PCQueueSize);
+  _MEMCHECK(Q);
+  Q->head = (char **)Q->data;
+  Q->tail = (char **)Q->data;
+  Q->len = 0;
+  Q->bufEnd = Q->data + PCQueueSize;
 
-/* Get index of pop node in the popped block */
-static inline DataNode get_pop_node(MPSCQueue Q, unsigned int pull_idx)
-{
-  unsigned int node_idx = get_node_index(pull_idx);
+#if CMK_PCQUEUE_LOCK || CMK_PCQUEUE_PUSH_LOCK
+  Q->lock = CmiCreateLock();
+#endif
 
-  return (DataNode)atomic_load_explicit(&Q->nodes[node_idx], std::memory_order_relaxed);
+  return Q;
 }
 
-/* Check whether or not a node is ready to be freed */
-static void check_mem_reclamation(MPSCQueue Q, unsigned int pull_idx, DataNode node)
+static void PCQueueDestroy(PCQueue Q)
 {
-  unsigned int node_idx = get_node_index(pull_idx);
-
-  /* If we are pulling from the end of a node, free the node */
-  if((pull_idx & DataNodeWrap) == (DataNodeSize - 1))
-  {
-    add_free_node(Q->freeNodePool, node);
-    std::atomic_store_explicit(&Q->nodes[node_idx], (uintptr_t)NULL, std::memory_order_relaxed);
-  }
+  free(Q->data);
+  free(Q);
 }
 
-static int MPSCQueueEmpty(MPSCQueue Q)
+static int PCQueueEmpty(PCQueue Q)
 {
-  unsigned int push = std::atomic_load_explicit(&Q->push, std::memory_order_relaxed);
-  unsigned int pull = Q->pull;
-  return WrappedDifference(push, pull) == 0;
+  return (PCQueue_CmiMemoryAtomicLoad(Q->len, std::memory_order_acquire) == 0);
 }
 
-static int MPSCQueueLength(MPSCQueue Q)
+static int PCQueueLength(PCQueue Q)
 {
-  unsigned int push = std::atomic_load_explicit(&Q->push, std::memory_order_relaxed);
-  unsigned int pull = Q->pull;
-  return (int)WrappedDifference(push, pull);
+  return PCQueue_CmiMemoryAtomicLoad(Q->len, std::memory_order_acquire);
 }
-
-static char *MPSCQueueTop(MPSCQueue Q)
+static char *PCQueueTop(PCQueue Q)
 {
-  unsigned int pull = Q->pull;
-  unsigned int push = std::atomic_load_explicit(&Q->push, std::memory_order_acquire);
 
-  DataNode node = get_pop_node(Q, pull);
+    char *data;
 
-  if(pull == push || node == NULL) return NULL; // Queue is empty
+#if CMK_PCQUEUE_LOCK
+    CmiLock(Q->lock);
+#endif
 
-  unsigned int node_pull = pull & DataNodeWrap;
+    data = *(Q->head);
+//    if(data == 0) return 0;
+     
+#if CMK_PCQUEUE_LOCK
+      CmiUnlock(Q->lock);
+#endif
 
-  char * data = node[node_pull];
-  return data;
+      return data;
 }
 
-static char *MPSCQueuePop(MPSCQueue Q)
+static char *PCQueuePop(PCQueue Q)
 {
-  unsigned int pull = Q->pull;
-  unsigned int push = std::atomic_load_explicit(&Q->push, std::memory_order_acquire);
-  if(pull == push) // If the queue is empty
-    return NULL;
 
-  DataNode node = get_pop_node(Q, pull);
-  if(node == NULL) // If a producer has not finished allocating the block we are attempting to pop from
-    return NULL;
+    char *data;
 
-  unsigned int node_pull = pull & DataNodeWrap;
+#if CMK_PCQUEUE_LOCK
+    CmiLock(Q->lock);
+#endif
 
-  char * data = node[node_pull];
-  if(data == NULL) // If a producer has not finished pushing an element we are attempting to pop
-    return NULL;
+    data = *(Q->head);
+//    if(data == 0) return 0;
+     
+    PCQueue_CmiMemoryReadFence();    
 
-  node[node_pull] = NULL; //NULL the element to indicate it is available again
+    if(data){
+      *(Q->head) = 0;
+      Q->head++;
 
-  Q->pull = (pull + 1);
+      if (Q->head == (char **)Q->bufEnd ) { 
+	Q->head = (char **)Q->data;
+      }
+      PCQueue_CmiMemoryAtomicDecrement(Q->len, std::memory_order_release);
 
-  check_mem_reclamation(Q, pull, node); //Check if we can free the node
+    }
 
-  return data;
-}
+#if CMK_PCQUEUE_LOCK
+      CmiUnlock(Q->lock);
+#endif
 
-static void MPSCQueuePush(MPSCQueue Q, char *data)
+      return data;
+}
+static void PCQueuePush(PCQueue Q, char *data)
 {
-  unsigned int push = std::atomic_fetch_add_explicit(&Q->push, 1u, std::memory_order_release);
-  unsigned int pull = Q->pull;
+#if CMK_PCQUEUE_LOCK || CMK_PCQUEUE_PUSH_LOCK
+  CmiLock(Q->lock);
+#endif
 
-  while(QueueFull(push, pull)) //Block until the push index is available to push to
-  {
-    ReportOverflow();
+  PCQueue_CmiMemoryWriteFence();
 
-    sched_yield();
-    pull = Q->pull;
+  //CmiAssert(*(Q->tail)==0);
+
+  *(Q->tail) = data;
+   Q->tail++;
+
+  if (Q->tail == (char **)Q->bufEnd) { /* last slot is about to be filled */
+    /* this way, the next buffer is linked in before data is filled in
+       in the last slot of this buffer */
+    Q->tail = (char **)Q->data;
   }
 
-  DataNode node = get_push_node(Q, push);
-  node[push & DataNodeWrap] = data;
+#if 0
+  if(Q->head == Q->tail && Q->len>0){ /* the whole buffer is fully occupied; len>0 is used to differentiate the case when the queue is empty in which head is also equal to tail*/
+       CmiAbort("Simple PCQueue is full!!\n");
+/*       char **newdata = (char **)malloc(sizeof(char *)*(Q->len << 1));
+       int rsize = Q->data + Q->curSize - Q->head;
+       int lsize = Q->tail - Q->data;
+       memcpy(newdata, Q->head, sizeof(char *)*rsize);
+       memcpy(newdata+rsize, Q->data, sizeof(char *)*lsize);
+       free(Q->data);
+       Q->data = newdata;
+       Q->head = newdata;
+       Q->tail = Q->data + Q->len;
+*/
+  }
+#endif
+
+  PCQueue_CmiMemoryAtomicIncrement(Q->len, std::memory_order_release);
+
+#if CMK_PCQUEUE_LOCK || CMK_PCQUEUE_PUSH_LOCK
+  CmiUnlock(Q->lock);
+#endif
 }
+#endif
 
+/* The simple pcqueue and non-SMP builds have no lock-free variant */
+#if !CMK_SMP || USE_SIMPLE_PCQUEUE
+#define PCQueueCreateLockless PCQueueCreate
+#endif
+
+// CMK_LOCKLESS_QUEUE (disabled by default)
+#if CMK_LOCKLESS_QUEUE
 
 /* BEGINNING OF MPMC CODE */
 /*
@@ -293,6 +293,21 @@ static inline void CkInvokeEP(Chare *obj, const int &epIdx, void *msg) {
   CkCallstackPop(obj);
 }
 
+/// The messages handed to a [coalesce] entry method in one call: a burst
+/// of messages for the same entry method on the same object, oldest first.
+/// The method takes ownership of each message, as with a single message.
+template <class M>
+struct CkMsgSpan {
+  M **msgs;
+  int count;
+
+  CkMsgSpan(M **m, int n) : msgs(m), count(n) {}
+  int size() const { return count; }
+  M *operator[](int i) const { return msgs[i]; }
+  M **begin() const { return msgs; }
+  M **end() const { return msgs + count; }
+};
+
 #if CMK_HAS_IS_CONSTRUCTIBLE
 #include <type_traits>
 
@@ -250,6 +250,11 @@ extern void CkRegisterMarshallUnpackFn(int epIndex,CkMarshallUnpackFn m);
 /** Lookup the marshall unpack function, if any, for this entry point.*/
 extern CkMarshallUnpackFn CkLookupMarshallUnpackFn(int epIndex);
 
+/** A "coalesce" function: calls a [coalesce] method with several messages.*/
+typedef void (*CkCoalesceFn)(void **msgs,int num,void *object);
+/** Register this coalesce function with this entry point.*/
+extern void CkRegisterCoalesceFn(int epIndex,CkCoalesceFn fn);
+
 #ifdef __cplusplus
 /** A "message pup" function: pups message data for debugger display. */
 typedef void (*CkMessagePupFn)(PUP::er &p,void *userMessage);
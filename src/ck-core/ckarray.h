@@ -134,6 +134,7 @@ public:
   static CkArrayID ckCreateArray(CkArrayMessage* m, int ctor, const CkArrayOptions& opts);
 
   void ckInsertIdx(CkArrayMessage* m, int ctor, int onPe, const CkArrayIndex& idx);
+  void ckBulkInsert(CkArrayMessage* m, int ctor, const std::vector<CkArrayIndex>& idxs);
   void ckBroadcast(CkArrayMessage* m, int ep, int opts = 0) const;
   CkArrayID ckGetArrayID(void) const { return _aid; }
   CkArray* ckLocalBranch(void) const { return _aid.ckLocalBranch(); }
@@ -658,8 +659,17 @@ class CkArray : public CkReductionMgr
   CkCallback initCallback;
   CProxy_CkArray thisProxy;
   // Separate mapping and storing the element pointers to speed iteration in broadcast
-  std::unordered_map<CmiUInt8, unsigned int> localElems;
+  ck::FlatHashMap<CmiUInt8, unsigned int> localElems;
   std::vector<CkMigratable*> localElemVec;
+  // Bumped whenever localElemVec changes
+  CmiUInt8 localElemsVersion = 0;
+
+  // Broadcast delivery order, when it is not the order of localElemVec. The
+  // ordered list is rebuilt lazily once localElemsVersion moves past bcastOrderVersion.
+  CkArrayOptions::BroadcastOrder bcastOrder = CkArrayOptions::BroadcastOrder::INSERTION;
+  std::vector<std::pair<CkMigratable*, CmiUInt8>> bcastOrderVec;
+  CmiUInt8 bcastOrderVersion = 0;
+  void updateBcastOrder();
 
   UShort recvBroadcastEpIdx;
 
@@ -750,6 +760,9 @@ public:
     return localElemVec.size();
   }
 
+  /// False between a beginInserting and the matching doneInserting
+  inline bool isDoneInserting() const { return !isInserting; }
+
   inline unsigned int getEltLocalIndex(const CmiUInt8 id) {
     const auto itr = localElems.find(id);
     return ( itr == localElems.end() ? -1 : itr->second);
@@ -764,6 +777,7 @@ public:
   {
     localElems[id] = localElemVec.size();
     localElemVec.push_back(elt);
+    localElemsVersion++;
   }
   virtual void eraseEltFromArrMgr(const CmiUInt8 id)
   {
@@ -782,6 +796,7 @@ public:
       }
 
       localElemVec.pop_back();
+      localElemsVersion++;
     }
   }
 
@@ -802,6 +817,7 @@ public:
       }
 
       localElemVec.pop_back();
+      localElemsVersion++;
     }
   }
 
@@ -829,6 +845,11 @@ public:
                      int listenerData[CK_ARRAYLISTENER_MAXLEN]);
   void insertElement(CkMarshalledMessage&&, const CkArrayIndex& idx,
                      int listenerData[CK_ARRAYLISTENER_MAXLEN]);
+  /// Create many elements that share one constructor message:
+  void insertElements(CkArrayMessage*, const std::vector<CkArrayIndex>& idxs,
+                      int listenerData[CK_ARRAYLISTENER_MAXLEN]);
+  void insertElements(CkMarshalledMessage&&, std::vector<CkArrayIndex>&& idxs,
+                      int listenerData[CK_ARRAYLISTENER_MAXLEN]);
 
   /// Broadcast communication:
   void sendBroadcast(CkMessage* msg);
@@ -859,6 +880,9 @@ private:
   /// Allocate space for a new array element
   ArrayElement* allocate(int elChareType, CkMessage* msg, bool fromMigration,
                          int* listenerData);
+  /// Register, build and construct an element known to belong on this PE
+  bool constructElement(CkArrayMessage* m, const CkArrayIndex& idx,
+                        int listenerData[CK_ARRAYLISTENER_MAXLEN], bool notifyHome);
 
   // Spring cleaning
   void springCleaning(void);
@@ -92,6 +92,17 @@ class CkArrayOptions {
   };
   InsertionType insertionType;
 
+ public:
+  /// Order in which each PE delivers a broadcast to its local elements
+  enum class BroadcastOrder : char {
+    INSERTION,  ///< Order the elements arrived on the PE (default)
+    MEMORY,     ///< Ascending element address, for cache and prefetch friendliness
+    INDEX       ///< Ascending array index
+  };
+
+ private:
+  BroadcastOrder broadcastOrder;
+
   /// Set various safe defaults for all the constructors
   void init();
 
@@ -264,6 +275,10 @@ class CkArrayOptions {
     broadcastViaScheduler = b;
     return *this;
   }
+  CkArrayOptions& setBroadcastOrder(BroadcastOrder o) {
+    broadcastOrder = o;
+    return *this;
+  }
   CkArrayOptions& setSectionAutoDelegate(bool b) {
     sectionAutoDelegate = b;
     return *this;
@@ -288,6 +303,7 @@ class CkArrayOptions {
   const CkGroupID& getMcastManager(void) const { return mCastMgr; }
   const CkGroupID& getLocationCache(void) const { return locCache; }
   bool isSectionAutoDelegated(void) const { return sectionAutoDelegate; }
+  BroadcastOrder getBroadcastOrder(void) const { return broadcastOrder; }
   const CkCallback &getInitCallback(void) const {return initCallback;}
   int getListeners(void) const { return arrayListeners.size(); }
   CkArrayListener* getListener(int listenerNum) {
@@ -9,7 +9,9 @@ array proxies, or the details of element creation (see ckarray.h).
 #ifndef __CKLOCATION_H
 #define __CKLOCATION_H
 
+#include <map>
 #include <unordered_map>
+#include "ckflathash.h"
 struct IndexHasher
 {
 public:
@@ -81,6 +83,16 @@ struct CkLocEntry {
 };
 PUPbytes(CkLocEntry);
 
+// Size and hit rate of a PE's location cache, see CkLocMgr::getLocationCacheStats
+struct CkLocCacheStats {
+  CmiUInt8 entries = 0;  // IDs with a known location
+  CmiUInt8 runs = 0;     // Runs of consecutive IDs sharing one location
+  CmiUInt8 singles = 0;  // Per-ID entries, including exceptions inside runs
+  CmiUInt8 bytes = 0;    // Memory held by the tables
+  CmiUInt8 lookups = 0;  // Location queries
+  CmiUInt8 hits = 0;     // Queries that found a location
+};
+
 #include "CkLocation.decl.h"
 
 /************************** Array Messages ****************************/
@@ -321,9 +333,47 @@ CkpvExtern(CkMigratable_initInfo, mig_initInfo);
 class CkLocCache : public CBase_CkLocCache
 {
 private:
-  // Map of ID to PE
-  using LocationMap = std::unordered_map<CmiUInt8, CkLocEntry>;
-  LocationMap locMap;
+  // Locations are stored as runs of consecutive IDs that share a PE and epoch, so
+  // a block-mapped array costs one entry per PE rather than one per element.
+  // Elements whose location differs from their run (usually because they migrated),
+  // and IDs that do not border a matching neighbour, are kept one per ID in singles,
+  // which takes precedence over runs.
+  struct Run
+  {
+    CmiUInt8 end;  // One past the last ID of the run
+    int pe;
+    int epoch;
+  };
+  using RunMap = std::map<CmiUInt8, Run>;  // Keyed by the first ID of the run
+  using LocationMap = ck::FlatHashMap<CmiUInt8, CkLocEntry>;
+  RunMap runs;
+  LocationMap singles;
+  mutable CmiUInt8 lookups = 0, hits = 0;
+
+  RunMap::iterator findRun(CmiUInt8 id);
+  RunMap::const_iterator findRun(CmiUInt8 id) const;
+  static bool sameLocation(const Run& r, const CkLocEntry& e)
+  {
+    return r.pe == e.pe && r.epoch == e.epoch;
+  }
+  CkLocEntry findEntry(CmiUInt8 id) const
+  {
+    if (!singles.empty())
+    {
+      LocationMap::const_iterator itr = singles.find(id);
+      if (itr != singles.end()) return itr->second;
+    }
+    RunMap::const_iterator run = findRun(id);
+    if (run == runs.end()) return CkLocEntry::nullEntry;
+    CkLocEntry e;
+    e.id = id;
+    e.pe = run->second.pe;
+    e.epoch = run->second.epoch;
+    return e;
+  }
+  void setEntry(const CkLocEntry& e);
+  bool joinRun(const CkLocEntry& e);
+  void absorbSingles(RunMap::iterator run);
 
   using Listener = std::function<void(CmiUInt8, int)>;
   std::list<Listener> listeners;
@@ -344,10 +394,12 @@ public:
   void recordEmigration(CmiUInt8 id, int pe);
 
   // Query the local location table
-  const CkLocEntry& getLocationEntry(CmiUInt8 id) const
+  CkLocEntry getLocationEntry(CmiUInt8 id) const
   {
-    LocationMap::const_iterator itr = locMap.find(id);
-    return itr != locMap.end() ? itr->second : CkLocEntry::nullEntry;
+    CkLocEntry e = findEntry(id);
+    lookups++;
+    if (e.pe != -1) hits++;
+    return e;
   }
   int getPe(const CmiUInt8 id) const { return getLocationEntry(id).pe; }
   int getEpoch(const CmiUInt8 id) const { return getLocationEntry(id).epoch; }
@@ -355,7 +407,11 @@ public:
 
   // Insertion and removal
   void insert(CmiUInt8 id, int epoch = 0);
-  void erase(CmiUInt8 id) { locMap.erase(id); }
+  void erase(CmiUInt8 id);
+
+  // Call fn on every known location
+  void forEachEntry(const std::function<void(const CkLocEntry&)>& fn) const;
+  CkLocCacheStats getStats() const;
 
   void addListener(Listener l) { listeners.push_back(l); }
   void notifyListeners(CmiUInt8 id, int pe) const
@@ -385,8 +441,8 @@ private:
   using MsgBuffer = std::unordered_map<CmiUInt8, std::vector<CkArrayMessage*> >;
   using LocationRequestBuffer =
       std::unordered_map<CkArrayIndex, std::vector<int>, IndexHasher>;
-  using IdxIdMap = std::unordered_map<CkArrayIndex, CmiUInt8, IndexHasher>;
-  using LocRecHash = std::unordered_map<CmiUInt8, CkLocRec*>;
+  using IdxIdMap = ck::FlatHashMap<CkArrayIndex, CmiUInt8, IndexHasher>;
+  using LocRecHash = ck::FlatHashMap<CmiUInt8, CkLocRec*>;
   using ElemMap = std::unordered_map<CmiUInt8, CkMigratable*>;
 
   using LocationListener = std::function<void(CmiUInt8, int)>;
@@ -495,8 +551,11 @@ public:
   bool isLocMgr(void) { return true; }
 
   CkGroupID getLocationCache() const { return cacheID; }
+  CkLocCacheStats getLocationCacheStats() const { return cache->getStats(); }
 
-  CkLocRec* registerNewElement(const CkArrayIndex& idx);
+  CkLocRec* registerNewElement(const CkArrayIndex& idx, bool notifyHome = true);
+  // Make room for n more local elements before a bulk insertion
+  void reserveElements(size_t n);
 
   // Interface used by external users:
   /// Home mapping
@@ -670,6 +729,8 @@ public:
   // Advisories:
   /// This index now lives on the given processor-- update local records
   void informHome(const CkArrayIndex& idx, int nowOnPe);
+  /// These new local indices now live here-- one update per home processor
+  void informHomes(const std::vector<CkArrayIndex>& idxs);
 
   /// This message took several hops to reach us-- fix it
   void multiHop(CkArrayMessage* m);
@@ -695,6 +756,8 @@ public:
   void requestLocation(const CkArrayIndex& idx);
   bool requestLocation(const CkArrayIndex& idx, int peToTell);
   void updateLocation(const CkArrayIndex& idx, const CkLocEntry& e);
+  void updateLocations(const std::vector<CkArrayIndex>& idxs,
+                       const std::vector<CkLocEntry>& entries);
   void reclaimRemote(const CkArrayIndex& idx, int deletedOnPe);
   void dummyAtSync(void);
 
@@ -15,6 +15,12 @@ PUPbytes(mCastEntryPtr)
 
 #define MAXMCASTCHILDREN 2
 
+/// CkMulticastMgr spanning tree options, or-ed together
+/// Retire and rebuild the whole tree when section members migrate, instead of repairing it
+#define MCAST_TREE_REBUILD  1
+/// Relay through the PEs of each physical node that hold the fewest section members
+#define MCAST_TREE_SHAPE    2
+
 #include "CkMulticast.decl.h"
 
 typedef void (*redClientFn)(CkSectionInfo sid, void *param,int dataSize,void *data);
@@ -35,20 +41,23 @@ class CkMulticastMgr: public CkDelegateMgr
         int dfactor;           // default spanning tree branch factor for this CkMulticastMgr, can be negative
         unsigned int split_size;
         unsigned int split_threshold;
+        int treeOpts;          // MCAST_TREE_* options
         
     public:
         // ------------------------- Cons/Des-tructors ------------------------
         CkMulticastMgr(CkMigrateMessage *m)  {}
-        CkMulticastMgr(int _dfactor = 2, unsigned int _split_size = 8192, unsigned int _split_threshold = 8192):
+        CkMulticastMgr(int _dfactor = 2, unsigned int _split_size = 8192, unsigned int _split_threshold = 8192, int _treeOpts = 0):
             dfactor(_dfactor),
             split_size(_split_size),
-            split_threshold(_split_threshold) {}
+            split_threshold(_split_threshold),
+            treeOpts(_treeOpts) {}
         bool useDefCtor(void){ return true; }
         void pup(PUP::er &p){ 
 		CkDelegateMgr::pup(p);
 		p|dfactor;
 		p|split_size;
 		p|split_threshold;
+		p|treeOpts;
 	}
 
         // ------------------------- Spanning Tree Setup ------------------------
@@ -73,6 +82,11 @@ class CkMulticastMgr: public CkDelegateMgr
         void retire(CkSectionInfo s, CkSectionInfo root);
         /// entry Actually frees the old spanning tree. Propagates the call to children
         void freeup(CkSectionInfo s);
+        // ------------------------- Spanning Tree Repair ------------------------
+        /// entry Replace the entries on the path to PEs whose section members changed, keeping the other subtrees
+        void repairSubtree(multicastSetupMsg *);
+        /// entry Attach an unchanged subtree to the repaired entry of its parent
+        void reparent(CkSectionInfo child, CkSectionInfo parent);
         // ------------------------- Section Cookie Management ------------------------
         /// entry 
         void retrieveCookie(CkSectionInfo s, CkSectionInfo srcInfo);
@@ -90,6 +104,8 @@ class CkMulticastMgr: public CkDelegateMgr
         void recvRedMsg(CkReductionMsg *msg);
         /// entry Update the current completed redn num to input value
         void updateRedNo(mCastEntryPtr, int red);
+        /// entry Send what the subtree holds of redn red straight to the root
+        void flushRedNo(mCastEntryPtr, int red);
         /// Configure a client to accept the reduction result
         void setReductionClient(CProxySection_ArrayElement &, redClientFn fn,void *param=NULL);
         /// Configure a client to accept the reduction result
@@ -121,6 +137,8 @@ class CkMulticastMgr: public CkDelegateMgr
         void SimpleSend(int ep,void *m, CkArrayID a, CkSectionID &sid, int opts);
         /// Retire and rebuild the spanning tree when one of the intermediate vertices migrates
         void rebuild(CkSectionInfo &);
+        /// Repair the spanning tree around the PEs whose section members migrated, or rebuild it if it is busy
+        void repairTree(CkSectionInfo &);
 
         // ------------------------- Group Section Functions ------------------------
         void setReductionClient(CProxySection_Group &proxy, CkCallback *cb);
@@ -140,6 +158,8 @@ class CkMulticastMgr: public CkDelegateMgr
         void releaseBufferedReduceMsgs(mCastEntryPtr entry);
         /// Release buffered redn msgs from later reductions which arrived early (out of order)
         void releaseFutureReduceMsgs(mCastEntryPtr entry);
+        /// Free the entries a repair replaced on this PE, and the subtrees it dropped
+        void freeRepaired(mCastEntryPtr entry);
         ///
         inline CkReductionMsg *buildContributeMsg(int dataSize,void *data,CkReduction::reducerType type, CkSectionInfo &id, CkCallback &cb, int userFlag=-1);
         /// Reduce one fragment of a reduction msg and handle appropriately (transmit up the tree, buffer, combine etc)
@@ -233,14 +233,25 @@ public:
 	//  nMsg gives the number of messages to reduce.
 	//  msgs[i] contains a contribution or summed contribution.
 	typedef CkReductionMsg *(*reducerFn)(int nMsg,CkReductionMsg **msgs);
+	//A foldFn combines one contribution of dataSize bytes into the
+	// running result acc, which has the same size, in place.
+	typedef void (*foldFn)(void *acc,const void *data,int dataSize);
 
   struct reducerStruct {
     reducerFn fn;
     bool streamable;
+    // Size in bytes of the items of an element-wise reducer, whose large
+    // messages can be reduced segment by segment; 0 if it needs whole messages
+    int segmentUnit;
+    // Lets local contributions be folded into one running result as they
+    // arrive, instead of each being kept in a message; NULL if unsupported
+    foldFn fold;
 #if CMK_ERROR_CHECKING
     const char *name; // aids in debugging conflicts between multiple overlapping reductions
 #endif
-    reducerStruct(reducerFn f=NULL, bool s=false, const char *n=NULL) : fn(f), streamable(s)
+    reducerStruct(reducerFn f=NULL, bool s=false, const char *n=NULL, int u=0,
+                  foldFn fo=NULL)
+                  : fn(f), streamable(s), segmentUnit(u), fold(fo)
 #if CMK_ERROR_CHECKING
                   ,name(n)
 #endif
@@ -249,12 +260,26 @@ public:
 
 	//Add the given reducer to the list.  Returns the new reducer's
 	// reducerType.  Must be called in the same order on every node.
-	static reducerType addReducer(reducerFn fn, bool streamable=false, const char* name=NULL);
+	static reducerType addReducer(reducerFn fn, bool streamable=false, const char* name=NULL,
+	                              int segmentUnit=0, foldFn fold=NULL);
+
+	//Returns the function that combines contributions for the given
+	// reducerType, e.g. to build a custom reducer on top of a built-in one.
+	static reducerFn getReducerFn(reducerType type);
+
+	//Returns the item size of an element-wise reducer, or 0 if it needs
+	// whole messages or type is not a registered reducer.
+	static int getSegmentUnit(reducerType type);
+
+	//Returns the fold function of the given reducerType, or NULL if it
+	// has none or type is not a registered reducer.
+	static foldFn getFoldFn(reducerType type);
 
 private:
 	friend class CkReductionMgr;
  	friend class CkNodeReductionMgr;
 	friend class CkMulticastMgr;
+	friend class CkReductionSegments;
     friend class ck::impl::XArraySectionReducer;
 //System-level interface
 
@@ -362,6 +387,7 @@ class CkReductionMsg : public CMessage_CkReductionMsg
 	friend class AllreduceMgr;
 #endif
 	friend class ck::impl::XArraySectionReducer;
+	friend class CkReductionSegments;
 public:
 
 //Publically-accessible fields:
@@ -431,6 +457,8 @@ private:
         int8_t nFrags;
         int8_t fragNo;      // fragment of a reduction msg (when pipelined)
                          // value = 0 to nFrags-1
+        int8_t nSegs;       // segment of a reduced msg sent up the tree in
+        int8_t segNo;       // pieces, see CkReductionSegments; 0 to nSegs-1
         CkSectionInfo sid;   // section cookie for multicast
 	CkCallback callback; //What to do when done
 	void *data;//Reduction data
@@ -438,6 +466,52 @@ private:
 };
 
 
+/**
+ * Pipelines large reductions through the tree. A reduced message of an
+ * element-wise reducer that is bigger than +reductionSegmentSize is sent to
+ * the parent as a run of segments (CkReductionMsg::nSegs/segNo), and the
+ * parent reduces and forwards segment k as soon as every child has sent it,
+ * rather than waiting for whole messages. Children may mix whole messages
+ * and segments; the root reassembles the result before handing it on.
+ */
+class CkReductionSegments {
+public:
+	CkReductionSegments() : base(NULL), result(NULL), next(0) {}
+	~CkReductionSegments() { clear(); }
+
+	//Number of segments m should be sent up the tree as (1 to send it whole)
+	static int count(const CkReductionMsg *m);
+	//Copy segment segNo of nSegs out of m, along with its counts
+	static CkReductionMsg *slice(const CkReductionMsg *m, int segNo, int nSegs);
+
+	//Were segments received for the current reduction?
+	bool pending() const { return !segs.empty(); }
+	//Has the first segment been reduced (so msgs was consumed)?
+	bool started() const { return base != NULL; }
+	//Have all the segments been reduced?
+	bool done() const { return pending() && next == (int)segs.size(); }
+
+	//Hold a segment sent by a child
+	void add(CkReductionMsg *m);
+	//Reduce the next segment if all nKids children have sent it, nWhole of
+	// them as whole messages already in msgs. msgs holds the local
+	// contributions, which must be complete; it is reduced once, on the first
+	// call. Returns NULL if the next segment is not ready.
+	CkReductionMsg *reduceNext(CkMsgQ<CkReductionMsg> &msgs, int nWhole, int nKids);
+	//At the root: copy a reduced segment into the result
+	void assemble(CkReductionMsg *seg);
+	//At the root: the reassembled result, once done(). Resets the state.
+	CkReductionMsg *takeResult();
+	void clear();
+	void pup(PUP::er &p);
+
+private:
+	std::vector<CkMsgQ<CkReductionMsg> > segs; //Children's segments, by segNo
+	CkReductionMsg *base;   //Local contributions and whole children's messages
+	CkReductionMsg *result; //Reassembled result at the root
+	int next;               //Next segment to reduce
+};
+
 #define CK_REDUCTION_CONTRIBUTE_METHODS_DECL \
   void contribute(int dataSize,const void *data,CkReduction::reducerType type, \
 	CMK_REFNUM_TYPE userFlag=(CMK_REFNUM_TYPE)-1); \
@@ -483,6 +557,9 @@ public:
 // Each contributor must contribute exactly once to each reduction.
 	void contribute(contributorInfo *ci,CkReductionMsg *msg);
 	void contributeWithCounter(contributorInfo *ci,CkReductionMsg *m,int count);
+	void contributeData(contributorInfo *ci,int dataSize,const void *data,
+	                    CkReduction::reducerType type,const CkCallback &cb,
+	                    CMK_REFNUM_TYPE userFlag,bool migratable);
 //Communication (library-private)
 	//Sent up the reduction tree with reduced data
 	void RecvMsg(CkReductionMsg *m);
@@ -515,6 +592,8 @@ private:
 	CkMsgQ<CkReductionMsg> futureRemoteMsgs;
 	//Late migrant messages queued for future reductions
 	CkMsgQ<CkReductionMsg> futureLateMigrantMsgs;
+	//Segments of large children's messages for the current reduction
+	CkReductionSegments segments;
 	
 	//My Big LOCK
 	CmiNodeLock lockEverything;
@@ -528,6 +607,9 @@ private:
 	void startReduction(int number,int srcPE);
 	void doAddContribution(CkReductionMsg *m);
 	void finishReduction(void);
+	void finishSegments(void);
+	void sendToParent(CkReductionMsg *m);
+	void endReduction(void);
 protected:	
 	void addContribution(CkReductionMsg *m);
 
@@ -628,6 +710,11 @@ public:
 // field of the message must be valid.
 // Each contributor must contribute exactly once to each reduction.
 	void contribute(contributorInfo *ci,CkReductionMsg *msg);
+//Contribute dataSize bytes of data, folding them straight into this
+// PE's running result when the reducer supports it.
+	void contributeData(contributorInfo *ci,int dataSize,const void *data,
+	                    CkReduction::reducerType type,const CkCallback &cb,
+	                    CMK_REFNUM_TYPE userFlag,bool migratable);
 
 //Communication (library-private)
 	//Sent down the reduction tree (used by barren PEs)
@@ -689,6 +776,9 @@ private:
 
 	//Contributions queued for the current reduction
 	CkMsgQ<CkReductionMsg> msgs;
+	//Running result of the local contributions to the current reduction
+	// that have been folded together; joins msgs once they are all in
+	CkReductionMsg *localAcc;
 
 	//Contributions queued for future reductions (sent to us too early)
 	CkMsgQ<CkReductionMsg> futureMsgs;
@@ -696,12 +786,19 @@ private:
 	CkMsgQ<CkReductionMsg> futureRemoteMsgs;
 
 	CkMsgQ<CkReductionMsg> finalMsgs;
+	//Segments of large children's messages for the current reduction
+	CkReductionSegments segments;
       std::unordered_map<int, int> inactiveList;
 
 //State:
 	void startReduction(int number,int srcPE);
 	void addContribution(CkReductionMsg *m);
+	bool canFold(CkReduction::reducerType type,int dataSize,const CkCallback &cb) const;
+	void foldContribution(CkReductionMsg *m);
 	void finishReduction(void);
+	void finishSegments(void);
+	void sendToParent(CkReductionMsg *m);
+	void endReduction(void);
   void checkIsActive();
   void informParentInactive();
   void checkAndAddToInactiveList(int id, int red_no);
@@ -781,19 +878,13 @@ public:
 void me::contribute(int dataSize,const void *data,CkReduction::reducerType type,\
 	CMK_REFNUM_TYPE userFlag)\
 {\
-	CkReductionMsg *msg=CkReductionMsg::buildNew(dataSize,data,type);\
-	msg->setUserFlag(userFlag);\
-	msg->setMigratableContributor(migratable);\
-	myRednMgr->contribute(&myRednInfo,msg);\
+	myRednMgr->contributeData(&myRednInfo,dataSize,data,type,CkCallback(),\
+		userFlag,migratable);\
 }\
 void me::contribute(int dataSize,const void *data,CkReduction::reducerType type,\
 	const CkCallback &cb,CMK_REFNUM_TYPE userFlag)\
 {\
-	CkReductionMsg *msg=CkReductionMsg::buildNew(dataSize,data,type);\
-	msg->setUserFlag(userFlag);\
-	msg->setCallback(cb);\
-	msg->setMigratableContributor(migratable);\
-	myRednMgr->contribute(&myRednInfo,msg);\
+	myRednMgr->contributeData(&myRednInfo,dataSize,data,type,cb,userFlag,migratable);\
 }\
 void me::contribute(CkReductionMsg *msg) \
 	{\
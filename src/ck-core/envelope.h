@@ -5,6 +5,7 @@
 #ifndef _ENVELOPE_H
 #define _ENVELOPE_H
 
+#include <cstddef>
 #include <pup.h>
 #include <charm.h>
 #include <middle.h>
@@ -135,12 +136,25 @@ namespace ck {
   namespace impl {
     /**
        These structures store the type-specific message information.
+
+       With CMK_COMPACT_ENVELOPE the union is packed to 2-byte alignment,
+       so its 14 bytes of payload are not padded out to 16, and forAnyPe
+       (a flag) only takes a byte, after the ints of its struct. Every
+       member still lands on its natural alignment inside the envelope;
+       the static_asserts below check the union's part of that.
     */
+#if CMK_COMPACT_ENVELOPE
+#pragma pack(push, 2)
+#endif
     union u_type {
       struct s_chare {  // NewChareMsg, NewVChareMsg, ForChareMsg, ForVidMsg, FillVidMsg
         void *ptr;      ///< object pointer
-        UInt forAnyPe;  ///< Used only by newChare
         int  bype;      ///< created by this pe
+#if CMK_COMPACT_ENVELOPE
+        UChar forAnyPe; ///< Used only by newChare
+#else
+        UInt forAnyPe;  ///< Used only by newChare
+#endif
       } chare;
       struct s_group {         // NodeBocInitMsg, BocInitMsg, ForNodeBocMsg, ForBocMsg, ArrayBcastMsg, ArrayBcastFwdMsg
         CkGroupID g;           ///< GroupID
@@ -165,6 +179,16 @@ namespace ck {
         UInt roIdx;
       } roMsg;
     };
+#if CMK_COMPACT_ENVELOPE
+#pragma pack(pop)
+#endif
+
+    static_assert(offsetof(u_type::s_chare, bype) % alignof(int) == 0,
+                  "envelope: chare.bype is misaligned");
+    static_assert(offsetof(u_type::s_group, arrayEp) % alignof(UShort) == 0,
+                  "envelope: group.arrayEp is misaligned");
+    static_assert(offsetof(u_type::s_array, arr) % alignof(CkGroupID) == 0,
+                  "envelope: array.arr is misaligned");
 
     struct s_attribs {  // Packed bitwise struct
       UChar msgIdx;     ///< Usertype of message (determines pack routine)
@@ -187,6 +211,27 @@ namespace ck {
 #define CMK_ENVELOPE_OPTIONAL_FIELDS
 #endif
 
+#if CMK_COMPACT_ENVELOPE
+/* Same fields, ordered so nothing is padded: with a 32-byte Converse header
+   and tracing off the whole envelope fits in one 64-byte cache line.
+   groupDepNum shrinks to a byte, limiting a message to 255 dependencies. */
+#define CMK_ENVELOPE_FIELDS                                                    \
+  /* Converse message envelope, Must be first field in this class */           \
+  char   core[CmiReservedHeaderSize];                                          \
+  UInt   pe;           /* source processor */                                  \
+  UInt   totalsize;    /* Byte count from envelope start to end of group dependencies */ \
+  ck::impl::u_type type; /* Depends on message type (attribs.mtype) */         \
+  CMK_ENVELOPE_OPTIONAL_FIELDS                                                 \
+  CMK_REFNUM_TYPE ref; /* Used by futures and SDAG */                          \
+  UShort priobits;     /* Number of bits of priority data after user data */   \
+  UShort epIdx;        /* Entry point to call */                               \
+  ck::impl::s_attribs attribs;                                                 \
+  UChar  groupDepNum;  /* Number of group dependencies */
+#define CMK_ENVELOPE_MAX_GROUP_DEPS 255
+#if CMK_SMP_TRACE_COMMTHREAD
+#error "The compact envelope cannot be combined with comm thread tracing"
+#endif
+#else
 #define CMK_ENVELOPE_FIELDS                                                    \
   /* Converse message envelope, Must be first field in this class */           \
   char   core[CmiReservedHeaderSize];                                          \
@@ -199,6 +244,8 @@ namespace ck {
   UShort groupDepNum;  /* Number of group dependencies */                      \
   UShort epIdx;        /* Entry point to call */                               \
   ck::impl::s_attribs attribs;
+#define CMK_ENVELOPE_MAX_GROUP_DEPS 65535
+#endif
 
 class envelope {
 private:
@@ -299,6 +346,8 @@ public:
       CkAssert(sizeof(CMK_MSG_PRIO_TYPE) >= sizeof(int)*CkPriobitsToInts(prio));
 #endif
 
+      CkAssert((int)groupDepNumRequest <= CMK_ENVELOPE_MAX_GROUP_DEPS);
+
       UInt tsize = sizeof(envelope)+ 
                    CkMsgAlignLength(size)+
                    sizeof(int)*CkPriobitsToInts(prio) +
@@ -64,6 +64,12 @@ class EntryInfo {
     */
     CkMarshallUnpackFn marshallUnpack;
 
+    /**
+      A "coalesce" function, for [coalesce] entry methods: calls the
+      method once with an array of messages that were queued for it.
+    */
+    CkCoalesceFn coalesce;
+
 #if CMK_CHARMDEBUG
     /** 
       A "message pup" function pups the message accepted by 
@@ -105,7 +111,7 @@ class EntryInfo {
 
     EntryInfo(const char *n, CkCallFnPtr c, int m, int ci, bool ownsN=false) :
       call(c), msgIdx(m), chareIdx(ci),
-      marshallUnpack(0)
+      marshallUnpack(0), coalesce(0)
 #if CMK_CHARMDEBUG
       ,messagePup(0)
 #endif
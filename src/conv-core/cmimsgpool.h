@@ -0,0 +1,39 @@
+/* Per-PE size-class cache for small CmiAlloc blocks */
+#ifndef CMIMSGPOOL_H
+#define CMIMSGPOOL_H
+
+#include "converse.h"
+
+/* The pool replaces plain malloc in CmiAlloc, so it is only compiled in
+   when CmiAlloc would otherwise call malloc_nomigrate. */
+#if CMK_MSG_POOL_HEADER && !(CMK_CONVERSE_UGNI || CMK_OFI) && !CONVERSE_POOL && !(CMK_SMP && CMK_PPC_ATOMIC_QUEUE)
+#define CMK_MSG_POOL 1
+#else
+#define CMK_MSG_POOL 0
+#endif
+
+#if CMK_MSG_POOL
+
+/* Blocks larger than this, including the chunk header, bypass the pool */
+#define CMI_MSG_POOL_MAX_BYTES 16384
+/* Default cap on the bytes a PE keeps in free blocks */
+#define CMI_MSG_POOL_DEFAULT_RETAIN (8 * 1024 * 1024)
+/* Initial size of a PE's mempool arena with +msgPoolHugepages */
+#define CMI_MSG_POOL_ARENA_BYTES (2 * 1024 * 1024)
+
+void CmiMsgPoolInit(char **argv);
+void CmiMsgPoolExit(void);
+
+/* Allocate a block of bytes (chunk header included) and fill in the
+   chunk header's pool fields. Falls back to malloc when the pool is off
+   or the block is too big. */
+CmiChunkHeader *CmiMsgPoolAlloc(size_t bytes);
+
+/* Return a block from CmiMsgPoolAlloc. May be called on any thread of
+   the process; blocks freed away from their owner are handed back to it
+   through a lock-free list. */
+void CmiMsgPoolFree(CmiChunkHeader *blk);
+
+#endif
+
+#endif /* CMIMSGPOOL_H */
@@ -10,6 +10,20 @@
 #define TASKQ_STEAL_EVENTID 149
 #define TASKQ_QUEUE_STEAL_EVENTID 151
 #endif
+
+/* Most tasks a thief takes from one victim at a time; it takes up to half
+   of the victim's queue, but no more than this. */
+#define TASKQ_STEAL_MAX 32
+
+/* Per-PE work stealing counters, all from the thief's point of view */
+typedef struct {
+  CmiUInt8 attempts;    /* Victims probed */
+  CmiUInt8 steals;      /* Probes that found at least one task */
+  CmiUInt8 localSteals; /* Successful probes of a PE in our NUMA domain */
+  CmiUInt8 tasks;       /* Tasks taken by all steals */
+} CmiTaskQueueStats_t;
+CpvExtern(CmiTaskQueueStats_t, CmiTaskQueueStats);
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -354,6 +354,11 @@ typedef struct {
 
 extern CmiSpanningTreeInfo* _topoTree; // this node's parent and children in topo-tree rooted at 0
 
+/* Branching factor of the topology-aware spanning tree used to broadcast a
+   message of msgSize bytes; msgSize 0 gives the factor of _topoTree */
+extern unsigned int CmiSpanningTreeBranch(int msgSize);
+extern void CmiInitSpanningTrees(char **argv);
+
 #if CMK_SHARED_VARS_UNAVAILABLE /* Non-SMP version of shared vars. */
 extern int _Cmi_mype;
 extern int _Cmi_numpes;
@@ -421,6 +426,8 @@ extern int _Cmi_mynode;
 extern int _Cmi_numnodes;
 extern int _Cmi_sleepOnIdle;
 extern int _Cmi_forceSpinOnIdle;
+extern int _Cmi_idlePolicy;
+extern int _Cmi_idleSpinUs;
 
 int CmiMyPe(void);
 int CmiMyRank(void);
@@ -673,6 +680,10 @@ extern int CmiSetCPUAffinity(int core);
 extern int CmiSetCPUAffinityLogical(int core);
 extern void CmiInitCPUTopology(char **argv);
 extern int CmiOnCore(void);
+extern int CmiOnNumaDomain(void);
+extern int CmiBoundNumaDomain(void);
+extern int CmiRankNumaDomain(int rank);
+extern int CmiMemoryBindToNumaNode(void *addr, size_t len, int nid);
 
 typedef struct
 {
@@ -720,6 +731,7 @@ CsvExtern(CmiNodeLock, CsdNodeQueueLock);
 CpvExtern(int,         CsdStopFlag);
 CpvExtern(int,         CsdLocalCount);
 #define CSD_LOCAL_MAX_DEFAULT 0
+#define CSD_BATCH_SIZE_DEFAULT 1
 
 extern void CmiAssignOnce(int* variable, int value);
 
@@ -777,6 +789,14 @@ CpvExtern(int, _curRestartPhase);      /* number of restarts */
 
 #if defined __cplusplus
 
+/* Whether the chunk header has room to record the message pool a block
+   belongs to (see cmimsgpool.h) */
+#if ALIGN_BYTES > 8 && !(CMK_USE_IBVERBS || CMK_USE_IBUD)
+#define CMK_MSG_POOL_HEADER 1
+#else
+#define CMK_MSG_POOL_HEADER 0
+#endif
+
 /** This header goes before each chunk of memory allocated with CmiAlloc. 
     See the comment in convcore.C for details on the fields.
 */
@@ -788,6 +808,12 @@ private:
 #else
   int ref;
 #endif
+#if CMK_MSG_POOL_HEADER
+public:
+  unsigned short poolRank;  /* Rank whose message pool the block returns to */
+  unsigned short poolClass; /* Size class in that pool, 0 if not pooled */
+private:
+#endif
 #if ALIGN_BYTES > 8
   #if defined(__GNUC__) || defined(__clang__)
   #pragma GCC diagnostic push
@@ -798,6 +824,9 @@ private:
   #endif
   char align[ALIGN_BYTES
              - sizeof(int)*2
+#if CMK_MSG_POOL_HEADER
+             - sizeof(unsigned short)*2
+#endif
 #if (CMK_USE_IBVERBS || CMK_USE_IBUD)
              - sizeof(void *)
 #endif
@@ -896,6 +925,19 @@ void CmiTmpFree(void *);
 
 /* Pool features */
 
+/** Counters of this PE's message pool (+msgPool), see cmimsgpool.C */
+typedef struct {
+  CMK_TYPEDEF_UINT8 hits;              /* CmiAllocs served from the pool */
+  CMK_TYPEDEF_UINT8 misses;            /* Pooled-size CmiAllocs that had to malloc */
+  CMK_TYPEDEF_UINT8 remoteFrees;       /* Blocks this PE returned to another rank */
+  CMK_TYPEDEF_UINT8 released;          /* Frees passed to free() because the pool was full */
+  CMK_TYPEDEF_UINT8 retainedBytes;     /* Bytes now held in free blocks */
+  CMK_TYPEDEF_UINT8 peakRetainedBytes; /* Most bytes ever held in free blocks */
+} CmiMsgPoolStats_t;
+
+/** Fill in this PE's message pool counters; returns 0 if the pool is off */
+int CmiMsgPoolGetStats(CmiMsgPoolStats_t *stats);
+
 
 /* Various special features of certain -memory modes: */
 extern void * memory_stack_top; /* contains the top of the stack, for -memory charmdebug */
@@ -993,29 +1035,19 @@ char *CmiPrintDate(void);
 
 #if CMK_NODE_QUEUE_AVAILABLE
 
-#define CsdNodeEnqueueGeneral(x,s,i,p) do { \
-          CmiLock(CsvAccess(CsdNodeQueueLock));\
-          CqsEnqueueGeneral((Queue)CsvAccess(CsdNodeQueue),(x),(s),(i),(p)); \
-          CmiUnlock(CsvAccess(CsdNodeQueueLock)); \
-        } while(0)
-#define CsdNodeEnqueueFifo(x)     do { \
-          CmiLock(CsvAccess(CsdNodeQueueLock));\
-          CqsEnqueueFifo((Queue)CsvAccess(CsdNodeQueue),(x)); \
-          CmiUnlock(CsvAccess(CsdNodeQueueLock)); \
-        } while(0)
-#define CsdNodeEnqueueLifo(x)     do { \
-          CmiLock(CsvAccess(CsdNodeQueueLock));\
-          CqsEnqueueLifo((Queue)CsvAccess(CsdNodeQueue),(x))); \
-          CmiUnlock(CsvAccess(CsdNodeQueueLock)); \
-        } while(0)
-#define CsdNodeEnqueue(x)     do { \
-          CmiLock(CsvAccess(CsdNodeQueueLock));\
-          CqsEnqueueFifo((Queue)CsvAccess(CsdNodeQueue),(x));\
-          CmiUnlock(CsvAccess(CsdNodeQueueLock)); \
-        } while(0)
+/* Zero-priority FIFO messages go to a lock-free ring; everything else
+   (and overflow from the ring) goes to CsdNodeQueue under its lock. */
+void CsdNodeQueuePush(void *msg, int strategy, int priobits, unsigned int *prioPtr);
+int CsdNodeQueueEmpty(void);
+unsigned int CsdNodeQueueLength(void);
+
+#define CsdNodeEnqueueGeneral(x,s,i,p) CsdNodeQueuePush((x),(s),(i),(p))
+#define CsdNodeEnqueueFifo(x)     CsdNodeQueuePush((x),CQS_QUEUEING_FIFO,0,NULL)
+#define CsdNodeEnqueueLifo(x)     CsdNodeQueuePush((x),CQS_QUEUEING_LIFO,0,NULL)
+#define CsdNodeEnqueue(x)         CsdNodeQueuePush((x),CQS_QUEUEING_FIFO,0,NULL)
 
-#define CsdNodeEmpty()            (CqsEmpty(C(Queue)pvAccess(CsdNodeQueue)))
-#define CsdNodeLength()           (CqsLength((Queue)CpvAccess(CsdNodeQueue)))
+#define CsdNodeEmpty()            (CsdNodeQueueEmpty())
+#define CsdNodeLength()           (CsdNodeQueueLength())
 
 #else
 
@@ -1141,6 +1173,16 @@ extern void  CsdEndIdle(void);
 extern void  CsdStillIdle(void);
 extern void  CsdBeginIdle(void);
 
+/** Per-PE statistics of the batches pulled by CsdNextMessages (+csdBatchSize) */
+typedef struct {
+  CmiUInt8 polls;       /* Calls to CsdNextMessages */
+  CmiUInt8 batches;     /* Calls that found at least one message */
+  CmiUInt8 fullBatches; /* Batches that stopped at the size limit */
+  CmiUInt8 messages;    /* Messages handed out from batches */
+  CmiUInt8 pulled;      /* Of those, messages moved in from the network queue */
+  int maxBatch;         /* Largest batch */
+} CsdBatchStats_t;
+
 typedef struct {
   void *localQ;
   Queue nodeQ;
@@ -1150,6 +1192,9 @@ typedef struct {
   Queue objQ;
 #endif
   CmiNodeLock nodeLock;
+  void *nodeRing;   /* Lock-free ring for zero-priority node messages */
+  int nodeSkip;     /* Polls left before looking at the node queue again */
+  int nodeBackoff;  /* Current number of polls to skip after finding it empty */
 #if CMK_GRID_QUEUE_AVAILABLE
   Queue gridQ;
 #endif
@@ -1157,14 +1202,38 @@ typedef struct {
   Queue taskQ;
   void *suspendedTaskQ;
 #endif
+  int batchSize;    /* Max messages per batch, 1 disables batching */
+  int batchLeft;    /* Messages of the current batch not yet handed out */
+  CsdBatchStats_t *batchStats;
 } CsdSchedulerState_t;
 extern void CsdSchedulerState_new(CsdSchedulerState_t *state);
 extern void *CsdNextMessage(CsdSchedulerState_t *state);
+extern int CsdNextMessages(CsdSchedulerState_t *state);
+CpvExtern(CsdBatchStats_t, CsdBatchStats);
 extern void *CsdNextLocalNodeMessage(CsdSchedulerState_t *state);
 
 extern void  *CmiGetNonLocal(void);
 extern void   CmiNotifyIdle(void);
 
+/* How an idle worker PE waits for messages, picked with +idlePolicy */
+#define CMI_IDLE_SPIN     0 /* Busy-poll the receive queues */
+#define CMI_IDLE_SLEEP    1 /* Poll a few times, then sleep on a growing timeout */
+#define CMI_IDLE_ADAPTIVE 2 /* Poll, back off or sleep based on the expected idle gap */
+
+typedef struct {
+  int policy;                  /* CMI_IDLE_SPIN, _SLEEP or _ADAPTIVE */
+  CMK_TYPEDEF_UINT8 idles;     /* Idle periods */
+  CMK_TYPEDEF_UINT8 polls;     /* Idle polls that busy-waited */
+  CMK_TYPEDEF_UINT8 yields;    /* Idle polls that paused and yielded the core */
+  CMK_TYPEDEF_UINT8 sleeps;    /* Sleeps on the idle lock */
+  CMK_TYPEDEF_UINT8 wakeups;   /* Sleeps ended by an incoming message */
+  CMK_TYPEDEF_UINT8 timeouts;  /* Sleeps that ran to their timeout */
+  double expectedGap;          /* Learned length of an idle period, in seconds */
+} CmiIdleStats_t;
+
+/** Fill in this PE's idle counters; returns 0 if it has none */
+int CmiGetIdleStats(CmiIdleStats_t *stats);
+
 /*Different kinds of schedulers: generic, eternal, counting, polling*/
 extern  int CsdScheduler(int maxmsgs);
 extern void CsdScheduleForever(void);
@@ -0,0 +1,111 @@
+#ifndef _MPMCRING_H
+#define _MPMCRING_H
+
+/** @file
+ * @brief Bounded lock-free multi-producer/multi-consumer queue
+ * @ingroup CharmScheduler
+ *
+ * A fixed-capacity ring of void* slots, each tagged with a sequence
+ * number (D. Vyukov's bounded MPMC queue). Producers and consumers each
+ * claim a slot with one compare-and-swap on their own index, so neither
+ * side ever blocks the other. Push fails when the ring is full, and the
+ * caller is expected to fall back to a locked queue. Used by the
+ * scheduler for zero-priority node-level messages.
+ */
+
+#include <atomic>
+#include <new>
+#include <stddef.h>
+
+typedef struct MPMCRingCellStruct {
+  std::atomic<size_t> seq;
+  void *data;
+} MPMCRingCell;
+
+typedef struct MPMCRingStruct {
+  alignas(CMI_CACHE_LINE_SIZE) std::atomic<size_t> enq; // Next slot to push into
+  alignas(CMI_CACHE_LINE_SIZE) std::atomic<size_t> deq; // Next slot to pop from
+  alignas(CMI_CACHE_LINE_SIZE) size_t mask;             // Capacity - 1, capacity is a power of two
+  MPMCRingCell *cells;
+} *MPMCRing;
+
+/** Create a queue with room for at least size entries */
+inline static MPMCRing MPMCRingCreate(size_t size) {
+  size_t capacity = 2;
+  while (capacity < size) capacity <<= 1;
+  MPMCRing Q = new (CmiAlignedAlloc(CMI_CACHE_LINE_SIZE, sizeof(struct MPMCRingStruct))) MPMCRingStruct;
+  Q->cells = (MPMCRingCell *)CmiAlignedAlloc(CMI_CACHE_LINE_SIZE, capacity * sizeof(MPMCRingCell));
+  for (size_t i = 0; i < capacity; i++) {
+    new (&Q->cells[i].seq) std::atomic<size_t>(i);
+    Q->cells[i].data = NULL;
+  }
+  Q->mask = capacity - 1;
+  Q->enq.store(0, std::memory_order_relaxed);
+  Q->deq.store(0, std::memory_order_relaxed);
+  return Q;
+}
+
+inline static void MPMCRingDestroy(MPMCRing Q) {
+  CmiAlignedFree(Q->cells);
+  Q->~MPMCRingStruct();
+  CmiAlignedFree(Q);
+}
+
+/** Append data to the queue. Returns 0, without enqueueing, if the queue is full. */
+inline static int MPMCRingPush(MPMCRing Q, void *data) {
+  MPMCRingCell *cell;
+  size_t pos = Q->enq.load(std::memory_order_relaxed);
+  while (1) {
+    cell = &Q->cells[pos & Q->mask];
+    size_t seq = cell->seq.load(std::memory_order_acquire);
+    ptrdiff_t dif = (ptrdiff_t)seq - (ptrdiff_t)pos;
+    if (dif == 0) {
+      if (Q->enq.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+        break;
+    } else if (dif < 0) {
+      return 0; // Slot still holds an entry from one lap ago: full
+    } else {
+      pos = Q->enq.load(std::memory_order_relaxed);
+    }
+  }
+  cell->data = data;
+  cell->seq.store(pos + 1, std::memory_order_release);
+  return 1;
+}
+
+/** Remove and return the oldest entry, or NULL if the queue is empty */
+inline static void *MPMCRingPop(MPMCRing Q) {
+  MPMCRingCell *cell;
+  size_t pos = Q->deq.load(std::memory_order_relaxed);
+  while (1) {
+    cell = &Q->cells[pos & Q->mask];
+    size_t seq = cell->seq.load(std::memory_order_acquire);
+    ptrdiff_t dif = (ptrdiff_t)seq - (ptrdiff_t)(pos + 1);
+    if (dif == 0) {
+      if (Q->deq.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+        break;
+    } else if (dif < 0) {
+      return NULL; // Slot not yet filled: empty
+    } else {
+      pos = Q->deq.load(std::memory_order_relaxed);
+    }
+  }
+  void *data = cell->data;
+  cell->seq.store(pos + Q->mask + 1, std::memory_order_release);
+  return data;
+}
+
+/** Whether the queue looked empty. Only reads the consumer index and one slot. */
+inline static int MPMCRingEmpty(MPMCRing Q) {
+  size_t pos = Q->deq.load(std::memory_order_relaxed);
+  return Q->cells[pos & Q->mask].seq.load(std::memory_order_acquire) != pos + 1;
+}
+
+/** Approximate number of entries, for statistics only */
+inline static size_t MPMCRingLength(MPMCRing Q) {
+  size_t e = Q->enq.load(std::memory_order_relaxed);
+  size_t d = Q->deq.load(std::memory_order_relaxed);
+  return e > d ? e - d : 0;
+}
+
+#endif
@@ -114,6 +114,72 @@ typedef struct prioq1_struct
 #endif
 */
 
+/**
+   Default for whether new Queues route integer priorities (IFIFO/ILIFO/
+   LFIFO/LLIFO) through the radix bucket queue instead of the prioq heap.
+   May also be changed at runtime with +radixPrioq / +noRadixPrioq.
+*/
+#ifndef CMK_RADIX_PRIOQ_DEFAULT
+#define CMK_RADIX_PRIOQ_DEFAULT 0
+#endif
+
+#define CQS_RADIX_BITS   6
+#define CQS_RADIX_FANOUT (1<<CQS_RADIX_BITS)
+#define CQS_RADIX_TOPSHIFT 60 /**< 64-bit keys: one 4-bit level, then ten 6-bit levels */
+#define CQS_RADIX_WINDOW 4096 /**< Integer priorities in [-2048,2048) are direct-mapped */
+
+/**
+   A bucket in a radix priority queue, holding all the entries that
+   share one integer priority.  The 64-bit key orders buckets the same
+   way CqsPrioGT orders the equivalent one or two word priority.
+*/
+typedef struct radixqelt_struct
+{
+  struct deq_struct data;
+  struct radixqelt_struct *next; /**< Next bucket in the queue's list of live buckets */
+  struct radixqelt_struct *prev; /**< Previous bucket in the list of live buckets */
+  CMK_TYPEDEF_UINT8 key;
+  struct prio_struct pri; /**< Must be last: data[] holds up to two ints */
+}
+*_radixqelt;
+
+/**
+   An interior node of a radix priority queue.  Each child is either
+   another node or (tagged with the low bit) a bucket; mask has bit i
+   set iff child[i] is in use, so the minimum is found with ctz.
+*/
+typedef struct radixqnode_struct
+{
+  CMK_TYPEDEF_UINT8 mask;
+  void *child[CQS_RADIX_FANOUT];
+}
+*_radixqnode;
+
+/**
+   A priority queue for integer (<= 64 bit) priorities.  Integer
+   priorities near zero index directly into a window of buckets, found
+   in order through a two-level bitmap.  Other priorities go in a 64-ary
+   bitmap trie of buckets, where buckets are only pushed down as far as
+   needed to tell them apart, so finding or retiring one touches at most
+   11 nodes.  Neither path compares priorities, and the minimum bucket
+   is cached so dequeueing from a live bucket is O(1).
+*/
+typedef struct radixq_struct
+{
+  _radixqelt min;      /**< Bucket with the smallest key, or NULL if empty */
+  _radixqelt *window;  /**< Direct-mapped buckets, allocated on first use; empty ones are kept */
+  CMK_TYPEDEF_UINT8 winsummary; /**< Bit i set iff winmask[i] != 0 */
+  CMK_TYPEDEF_UINT8 winmask[CQS_RADIX_WINDOW/64]; /**< Bit set iff the window bucket is non-empty */
+  struct radixqnode_struct root;
+  _radixqelt triemin;  /**< Bucket in the trie with the smallest key */
+  _radixqelt last;     /**< Trie bucket used by the most recent enqueue */
+  _radixqelt buckets;  /**< List of all non-empty buckets */
+  _radixqelt freeelts; /**< Retired trie buckets kept for reuse */
+  _radixqnode freenodes; /**< Retired trie nodes kept for reuse (linked through child[0]) */
+  int numfreeelts;
+}
+*_radixq;
+
 /*#ifndef FASTQ*/
 /**
    A set of 3 queues: a positive priority prioq_struct, a negative
@@ -132,6 +198,8 @@ typedef struct Queue_struct
   struct deq_struct zeroprio; /**< A double ended queue for zero priority messages */
   struct prioq_struct negprioq; /**< A priority queue for negative priority messages */
   struct prioq_struct posprioq; /**< A priority queue for negative priority messages */
+  int useradix; /**< Whether integer priorities go to radixq rather than the prioqs */
+  struct radixq_struct radixq; /**< Integer priorities of either sign, when useradix is set */
 #endif
 }
 *Queue;
@@ -157,6 +225,13 @@ Queue CqsCreate(void);
 /** Delete a Queue */
 void CqsDelete(Queue);
 
+/**
+    Choose whether integer priorities enqueued on q use the radix bucket
+    queue (enable != 0) or the general bitvector prioq heap.  Bitvector
+    priorities always use the heap.  q must be empty.
+*/
+void CqsSetRadixPrioq(Queue q, int enable);
+
 /** Enqueue with priority 0 */
 void CqsEnqueue(Queue, void *msg);
 
@@ -184,6 +259,24 @@ void CqsEnqueueGeneral(Queue, void *msg, int strategy,
 */
 void CqsEnumerateQueue(Queue q, void ***resp);
 
+/** Decides whether CqsExtract takes an entry; nonzero means take it */
+typedef int (*CqsMatchFn)(void *msg, void *arg);
+
+/**
+    Remove matching entries from among the oldest entries queued with
+    priority 0, keeping the order of the ones left behind. The removed
+    entries may have been queued behind entries that do not match, so
+    this reorders priority 0 entries; nothing is removed while entries
+    of negative priority are queued.
+    @return the number of entries removed, at most max
+    @param [in] q a Queue
+    @param [in] match called on each entry looked at, with arg
+    @param [in] scan how many of the oldest priority 0 entries to look at
+    @param [out] out the removed entries, oldest first; room for max
+    Always returns 0 when messages are kept in the STL-based queue.
+*/
+int CqsExtract(Queue q, CqsMatchFn match, void *arg, int scan, void **out, int max);
+
 /**
    Retrieve the highest priority message (one with most negative
    priority)
@@ -1,80 +1,147 @@
 #ifndef _CKTASKQUEUE_H
 #define _CKTASKQUEUE_H
+#include <atomic>
+#include <new>
+#include <stdlib.h>
+// Initial number of slots; the queue doubles whenever the owner fills it
 #define TaskQueueSize 1024
 //Uncomment for debug print statements
 #define TaskQueueDebug(...) //CmiPrintf(__VA_ARGS__)
-// This taskqueue implementation refers to the work-stealing queue of Cilk (THE protocol).
+// This taskqueue implementation is the Chase-Lev work-stealing deque
+// ("Dynamic Circular Work-Stealing Deque", SPAA 2005), with the memory
+// orderings of Le et al. ("Correct and Efficient Work-Stealing for Weak
+// Memory Models", PPoPP 2013).
 // New tasks are pushed into the tail of this queue and the tasks are popped at the tail of this queue by the same thread. Thieves(other threads trying to steal) steal a task at the head of this queue.
 // So, synchronization is needed only when there is only one task in the queue because thieves and victim can try to obtain the same task.
-#ifdef _WIN32
-#define WIN32_LEAN_AND_MEAN
-#include <windows.h>
-typedef LONG taskq_idx;
-#else
-typedef int taskq_idx;
-#endif
+// Unlike the fixed-size THE queue this replaces, the owner grows the ring
+// when it is full instead of overwriting tasks that have not run yet.
+// Thieves may still be reading a ring the owner has replaced, so replaced
+// rings are kept on a list until the queue is destroyed; since each ring
+// is twice the size of the previous one this costs at most the size of the
+// current ring again.
+typedef CmiInt8 taskq_idx;
+
+typedef struct TaskQueueRingStruct {
+  taskq_idx mask; // Number of slots - 1, the number of slots is a power of 2
+  struct TaskQueueRingStruct *retired; // Ring this one replaced
+  std::atomic<void *> data[1];
+} *TaskQueueRing;
+
 typedef struct TaskQueueStruct {
-  taskq_idx head; // This pointer indicates the first task in the queue
-  taskq_idx tail; // The tail indicates the array element next to the last available task in the queue. So, if head == tail, the queue is empty
-  void *data[TaskQueueSize];
+  alignas(CMI_CACHE_LINE_SIZE) std::atomic<taskq_idx> head; // This pointer indicates the first task in the queue
+  alignas(CMI_CACHE_LINE_SIZE) std::atomic<taskq_idx> tail; // The tail indicates the array element next to the last available task in the queue. So, if head == tail, the queue is empty
+  std::atomic<TaskQueueRing> ring;
 } *TaskQueue;
 
+inline static TaskQueueRing TaskQueueRingCreate(taskq_idx size) {
+  TaskQueueRing r = (TaskQueueRing)malloc(sizeof(struct TaskQueueRingStruct) + (size - 1) * sizeof(std::atomic<void *>));
+  _MEMCHECK(r);
+  r->mask = size - 1;
+  r->retired = NULL;
+  for (taskq_idx i = 0; i < size; i++)
+    new (&r->data[i]) std::atomic<void *>(NULL);
+  return r;
+}
+
 inline static TaskQueue TaskQueueCreate() {
-  TaskQueue t = (TaskQueue)malloc(sizeof(struct TaskQueueStruct));
-  t->head = 0;
-  t->tail = 0;
+  TaskQueue t = (TaskQueue)CmiAlignedAlloc(CMI_CACHE_LINE_SIZE, sizeof(struct TaskQueueStruct));
+  _MEMCHECK(t);
+  new (&t->head) std::atomic<taskq_idx>(0);
+  new (&t->tail) std::atomic<taskq_idx>(0);
+  new (&t->ring) std::atomic<TaskQueueRing>(TaskQueueRingCreate(TaskQueueSize));
   return t;
 }
 
+// Only safe once no thief can be looking at the queue any more
+inline static void TaskQueueDestroy(TaskQueue Q) {
+  TaskQueueRing r = Q->ring.load(std::memory_order_relaxed);
+  while (r != NULL) {
+    TaskQueueRing retired = r->retired;
+    free(r);
+    r = retired;
+  }
+  CmiAlignedFree(Q);
+}
+
+// Number of tasks in the queue; only a hint when read by a thief
+inline static int TaskQueueLength(TaskQueue Q) {
+  taskq_idx h = Q->head.load(std::memory_order_relaxed);
+  taskq_idx t = Q->tail.load(std::memory_order_relaxed);
+  return t > h ? (int)(t - h) : 0;
+}
+
+// Called by the owner only: move tasks [h, t) into a ring twice the size
+inline static TaskQueueRing TaskQueueGrow(TaskQueue Q, TaskQueueRing r, taskq_idx h, taskq_idx t) {
+  TaskQueueRing bigger = TaskQueueRingCreate(2 * (r->mask + 1));
+  TaskQueueDebug("[%d] TaskQueueGrow to %lld slots\n", CmiMyPe(), (long long)(bigger->mask + 1));
+  for (taskq_idx i = h; i < t; i++)
+    bigger->data[i & bigger->mask].store(r->data[i & r->mask].load(std::memory_order_relaxed), std::memory_order_relaxed);
+  bigger->retired = r;
+  Q->ring.store(bigger, std::memory_order_release);
+  return bigger;
+}
+
 inline static void TaskQueuePush(TaskQueue Q, void *data) {
-  Q->data[ Q->tail % TaskQueueSize] = data;
-  CmiMemoryWriteFence();
-  Q->tail +=1;
+  taskq_idx t = Q->tail.load(std::memory_order_relaxed);
+  taskq_idx h = Q->head.load(std::memory_order_acquire);
+  TaskQueueRing r = Q->ring.load(std::memory_order_relaxed);
+  if (t - h > r->mask)
+    r = TaskQueueGrow(Q, r, h, t);
+  r->data[t & r->mask].store(data, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  Q->tail.store(t + 1, std::memory_order_relaxed);
 }
 
 inline static void* TaskQueuePop(TaskQueue Q) { // Pop happens in the same worker thread which pushed the task before.
-  TaskQueueDebug("[%d] TaskQueuePop head %d tail %d\n", CmiMyPe(), Q->head, Q->tail);
-  taskq_idx h, t;
-  t = Q->tail -1;
-  Q->tail = t;
-  CmiMemoryWriteFence();
-  h = Q->head;
-  if (t > h) { // This means there are more than two tasks in the queue, so it is safe to pop a task from the queue.
-    TaskQueueDebug("[%d] returning valid data\n", CmiMyPe());
-    return Q->data[t % TaskQueueSize];
-  }
-
+  taskq_idx t = Q->tail.load(std::memory_order_relaxed) - 1;
+  TaskQueueRing r = Q->ring.load(std::memory_order_relaxed);
+  Q->tail.store(t, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  taskq_idx h = Q->head.load(std::memory_order_relaxed);
+  TaskQueueDebug("[%d] TaskQueuePop head %lld tail %lld\n", CmiMyPe(), (long long)h, (long long)t);
   if (t < h) { // The taskqueue is empty and the last task has been stolen by a thief.
-    Q->tail = h;
+    Q->tail.store(h, std::memory_order_relaxed);
     return NULL;
   }
+  void *task = r->data[t & r->mask].load(std::memory_order_relaxed);
+  if (t > h) // This means there are more than two tasks in the queue, so it is safe to pop a task from the queue.
+    return task;
   // From now on, we should handle the situation where there is only one task so thieves and victim can try to obtain this task simultaneously.
-  Q->tail = h + 1;
-#ifdef _WIN32
-  if (h != InterlockedCompareExchange(&(Q->head), h+1,h))
-#else
-  if (!__sync_bool_compare_and_swap(&(Q->head), h, h+1)) // Check whether the last task has already stolen.
-#endif
-    return NULL;
-  return Q->data[t % TaskQueueSize];
+  if (!Q->head.compare_exchange_strong(h, h + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+    task = NULL; // The last task has already been stolen.
+  Q->tail.store(t + 1, std::memory_order_relaxed);
+  return task;
 }
 
 inline static void* TaskQueueSteal(TaskQueue Q) {
-  taskq_idx h, t;
-  void *task;
   while (1) {
-    h = Q->head;
-    t = Q->tail;
+    taskq_idx h = Q->head.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    taskq_idx t = Q->tail.load(std::memory_order_acquire);
     if (h >= t) // The queue is empty or the last element has been stolen by other thieves or popped by the victim.
       return NULL;
-#ifdef _WIN32
-    if (h != InterlockedCompareExchange(&(Q->head), h+1, h))
-#else
-    if (!__sync_bool_compare_and_swap(&(Q->head), h, h+1)) // Check whether the task this thief is trying to steal is still in the queue and not stolen by the other thieves.
-#endif
-      continue;
-    return Q->data[h % TaskQueueSize];
+    TaskQueueRing r = Q->ring.load(std::memory_order_acquire);
+    void *task = r->data[h & r->mask].load(std::memory_order_relaxed);
+    // Check whether the task this thief is trying to steal is still in the queue and not stolen by the other thieves.
+    if (Q->head.compare_exchange_strong(h, h + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+      return task;
+  }
+}
+
+// Steal up to half of the tasks in Q, at most max of them, into tasks[].
+// Each task is claimed with its own CAS on head: claiming a whole range
+// at once could hand a thief a task the owner has already popped without
+// synchronizing. Returns the number of tasks stolen.
+inline static int TaskQueueStealHalf(TaskQueue Q, void **tasks, int max) {
+  int half = (TaskQueueLength(Q) + 1) / 2;
+  if (half > max) half = max;
+  int n = 0;
+  while (n < half) {
+    void *task = TaskQueueSteal(Q);
+    if (task == NULL) break;
+    tasks[n++] = task;
   }
+  return n;
 }
 
 #endif
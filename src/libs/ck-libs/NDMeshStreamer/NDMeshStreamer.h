@@ -2,12 +2,18 @@
 #define NDMESH_STREAMER_H
 
 #include <algorithm>
+#include <atomic>
 #include <cstring>
 #include <cstdint>
 #include <vector>
 #include <list>
 #include <map>
+#include <thread>
 #include <type_traits>
+#include <unordered_map>
+#if CMK_AMD64
+#include <immintrin.h>
+#endif
 #include "pup.h"
 #include "NDMeshStreamer.decl.h"
 #include "DataItemTypes.h"
@@ -74,6 +80,125 @@ struct is_PUPbytes {
   static const bool value = false;
 };
 
+// Opt-in combining of data items on their way to the same destination.
+// Specialize with enabled = true to have items with equal keys for the
+// same destination merged in the aggregation buffers at the source and at
+// every intermediate destination, so that they cross the network once:
+//
+//   template <>
+//   struct TramCombiner<Update> {
+//     static const bool enabled = true;
+//     static CmiUInt8 key(const Update &u) { return u.vertex; }
+//     static void combine(Update &acc, const Update &u) { acc.delta += u.delta; }
+//   };
+//
+// combine must be associative and commutative, and must not change the
+// packed size of acc; items whose packed size would change are sent
+// separately instead.
+template <typename dtype>
+struct TramCombiner {
+  static const bool enabled = false;
+  static CmiUInt8 key(const dtype &) { return 0; }
+  static void combine(dtype &, const dtype &) {}
+};
+
+// Buffered item of a given key for a given PE
+struct TramCombineKey {
+  int destinationPe;
+  CmiUInt8 key;
+
+  bool operator==(const TramCombineKey &other) const {
+    return destinationPe == other.destinationPe && key == other.key;
+  }
+};
+
+struct TramCombineKeyHash {
+  size_t operator()(const TramCombineKey &k) const {
+    return std::hash<CmiUInt8>()(k.key * 0x9e3779b97f4a7c15ULL + k.destinationPe);
+  }
+};
+
+// Key -> index of the item in an aggregation buffer
+typedef std::unordered_map<TramCombineKey, int, TramCombineKeyHash> TramCombineIndex;
+
+// Why a buffer was sent, see MeshStreamer::numFlushes
+enum TramFlushReason {
+  TRAM_FLUSH_FULL,          // the buffer reached its size
+  TRAM_FLUSH_CAPACITY,      // the PE reached its total buffering capacity
+  TRAM_FLUSH_LATENCY,       // the oldest item reached the latency budget
+  TRAM_FLUSH_IDLE,          // the PE went idle and the buffer would not fill in time
+  TRAM_FLUSH_PERIODIC,      // nothing was sent since the last periodic flush
+  TRAM_FLUSH_COMPLETION,    // staged completion or an explicit flush
+  TRAM_FLUSH_LARGE_ITEM,    // a single item too large to aggregate
+  TRAM_NUM_FLUSH_REASONS
+};
+
+// Defaults for adaptive flushing, from +tramAdaptiveFlush,
+// +tramLatencyBudget and +tramMemoryCap
+extern bool _tramAdaptiveFlush;
+extern double _tramLatencyBudgetMs;
+extern int _tramMemoryCap;
+// Messages of at least this many bytes go to their final destination
+// through the zero-copy API, from +tramZeroCopyThreshold; -1 disables it
+extern int _tramZeroCopyThreshold;
+void _initTramFlushPolicy(void);
+
+// Adaptive flushing state of an aggregation buffer
+struct TramBufferState {
+  double firstItemTime;   // when the current buffer got its first item
+  int threshold;          // bytes at which the current buffer is sent
+  int target;             // threshold for the next buffer
+  int arrivedBytes;       // bytes buffered since the last progress check
+  double byteRate;        // bytes per ms, smoothed over progress checks
+};
+PUPbytes(TramBufferState)
+
+// Pauses a thread waiting for a full TramNodeBuffer to be replaced: spin
+// with exponentially more pause hints, then yield the core to the OS once
+// TRAM_NODE_MAX_SPINS rounds have gone by, so the sending thread is not
+// starved when the node's PEs are oversubscribed.
+#define TRAM_NODE_MAX_SPINS 10
+inline void tramNodeBackoff(int round) {
+  if (round >= TRAM_NODE_MAX_SPINS) {
+    std::this_thread::yield();
+    return;
+  }
+  for (int i = 0; i < (1 << round); i++) {
+#if CMK_AMD64
+    _mm_pause();
+#elif CMK_ARM
+    asm volatile("yield");
+#endif
+  }
+}
+
+// Aggregation buffer of a NodeGroupMeshStreamer for one destination node,
+// filled by all PEs of the process. A thread takes a slot by incrementing
+// reserved and counts it in written once the item is in. The thread that
+// brings written to the capacity sends the message, puts a new one in
+// place and only then resets reserved, so threads that found the buffer
+// full wait for the new message, backing off (tramNodeBackoff) as they
+// spin. A flush closes the buffer by raising
+// reserved to the capacity and adding the slots it took to written.
+struct TramNodeBuffer {
+  std::atomic<int> reserved;
+  std::atomic<int> written;
+  int limit;                     // items in the message once it is sent
+  MeshStreamerMessageV *msg;
+  char padding[CMI_CACHE_LINE_SIZE]; // keep buffers off each other's lines
+};
+
+// Items of a NodeGroupMeshStreamer message for another PE of the node,
+// pushed onto that PE's queue; the items follow the header
+struct TramNodeDeliveryMsg {
+  char core[CmiMsgHeaderSizeBytes];
+  void (*deliver)(void *streamer, TramNodeDeliveryMsg *msg);
+  void *streamer;
+  int numDataItems;
+};
+CpvExtern(int, _tramNodeDeliveryHandlerIdx);
+void _registerTramNodeHandler(void);
+
 template <class dtype>
 struct DataItemHandle {
   CkArrayIndex arrayIndex;
@@ -90,6 +215,9 @@ public:
   int msgType;
   int numDataItems;
   bool fixedSize;
+  // shape the message was allocated with, see MeshStreamer::newMessage
+  int numIndices;
+  int dataCapacity;
   int *destinationPes;
   int *sourcePes;
   char *dataItems;
@@ -103,6 +231,16 @@ public:
     }
   }
 
+  // empty a received or sent message so it can be filled again
+  inline void reset(int t) {
+    numDataItems = 0;
+    msgType = t;
+    finalMsgCount = -1;
+    if (!fixedSize) {
+      offsets[0] = 0;
+    }
+  }
+
   template <typename dtype>
   inline typename std::enable_if<is_PUPbytes<dtype>::value,int>::type addDataItem(dtype& dataItem, CkArrayIndex index, int sourcePe) {
     char* offset = dataItems + (numDataItems*sizeof(dtype));
@@ -179,6 +317,38 @@ private:
   bool isPeriodicFlushEnabled_;
   bool hasSentRecently_;
   std::vector<std::vector<MeshStreamerMessageV * > > dataBuffers_;
+  // only used with a TramCombiner: buffered items by key, per buffer
+  std::vector<std::vector<TramCombineIndex> > combineIndex_;
+  CmiUInt8 numItemsSent_;
+  CmiUInt8 numItemsCombined_;
+
+  // only used for adaptive flushing
+  bool adaptiveFlush_;
+  bool idleProgressRegistered_;
+  double latencyBudgetMs_;
+  int memoryCap_;
+  double lastProgressTime_;
+  std::vector<std::vector<TramBufferState> > bufferState_;
+
+  int bufferedBytes_;
+  CmiUInt8 numFlushes_[TRAM_NUM_FLUSH_REASONS];
+  CmiUInt8 numBytesSent_;
+  CmiUInt8 numBuffersSent_;
+
+  // Messages of the standard shape, bufferSize_ bytes and room for
+  // maxItemsBuffered items (or none, for personalized messages), are
+  // kept after they are delivered (or pulled through the zero-copy API)
+  // and filled again rather than freed, up to two per peer buffer: one
+  // being filled and one in flight. They are not migrated.
+  std::vector<MeshStreamerMessageV *> messagePool_[2];
+  int maxPooledMessages_;
+  CmiUInt8 numMessagesAllocated_;
+  CmiUInt8 numZeroCopyMessages_;
+  int zeroCopyThreshold_;
+  CkCallback zeroCopySentCb_;
+  // sent through the zero-copy API and not yet pulled, or posted to
+  // receive into, by the address of their body
+  std::unordered_map<char *, MeshStreamerMessageV *> zeroCopyMessages_;
 
   CProxy_CompletionDetector detector_;
   int prio_;
@@ -204,8 +374,24 @@ private:
   virtual void initLocalClients() { CkAbort("Called what should be a pure virtual base method"); }
 
   void sendLargestBuffer();
+  void sendBuffer(int dimension, int index, TramFlushReason reason);
   void flushToIntermediateDestinations();
   void flushDimension(int dimension, bool sendMsgCounts = false);
+  int startBuffer(int dimension, int index);
+  MeshStreamerMessageV *newMessage(int dimension, int numIndices, int dataSize);
+  bool isStandardMessage(const MeshStreamerMessageV *msg) const;
+  void updateRate(TramBufferState &state, double byteRate);
+  void bufferFilled(int dimension, int index, int numBytes);
+  void registerIdleProgressFunction();
+
+  inline int cutoffBytes() const {
+    return cutoffFractionNumerator*(bufferSize_/cutoffFractionDenominator);
+  }
+  // largest fill at which a buffer is sent under adaptive flushing
+  inline int maxThreshold() const {
+    return std::min(thresholdFractionNumerator*(bufferSize_/thresholdFractionDenominator),
+                    cutoffBytes());
+  }
 
 protected:
 
@@ -231,6 +417,10 @@ protected:
   void storeMessage(int destinationPe,
                     const Route& destinationCoordinates,
                     const DataItemHandle<dtype> *dataItem, bool copyIndirectly = false);
+  bool combineItem(MeshStreamerMessageV *destinationBuffer,
+                   TramCombineIndex &combineIndex, int destinationPe,
+                   const CkArrayIndex &destinationObject, dtype &dataItem);
+  void recycleMessage(MeshStreamerMessageV *msg);
 
   void ctorHelper(int maxNumDataItemsBuffered, int numDimensions,
                   int *dimensionSizes, int bufferSize,
@@ -241,10 +431,17 @@ protected:
 public:
   MeshStreamer() {}
   MeshStreamer(CkMigrateMessage *) {}
+  ~MeshStreamer();
 
   // entry
 
   void receiveAlongRoute(MeshStreamerMessageV *msg);
+  void receiveZeroCopy(int &msgType, int &finalMsgCount, int &numDataItems,
+                       bool &personalized, int &size, char *&body,
+                       CkNcpyBufferPost *ncpyPost);
+  void receiveZeroCopy(int msgType, int finalMsgCount, int numDataItems,
+                       bool personalized, int size, char *body);
+  void zeroCopySent(CkDataMsg *m);
   void enablePeriodicFlushing(){
     if (progressPeriodInMs_ <= 0) {
       if (myIndex_ == 0) {
@@ -256,8 +453,13 @@ public:
     }
 
     isPeriodicFlushEnabled_ = true;
+    if (_tramAdaptiveFlush) {
+      enableAdaptiveFlushing(_tramLatencyBudgetMs, _tramMemoryCap);
+      return;
+    }
     registerPeriodicProgressFunction();
   }
+  void enableAdaptiveFlushing(double latencyBudgetMs, int memoryCap);
   void finish();
   void init(int numLocalContributors, CkCallback startCb, CkCallback endCb,
             int prio, bool usePeriodicFlushing);
@@ -274,12 +476,43 @@ public:
 
   // non entry
   void flushIfIdle();
+  void adaptiveProgress(bool idle);
+  void idleProgress();
+  inline bool isAdaptiveFlushEnabled() {
+    return adaptiveFlush_;
+  }
   inline bool isPeriodicFlushEnabled() {
     return isPeriodicFlushEnabled_;
   }
+  // data items sent to other PEs, counting every hop
+  inline CmiUInt8 numItemsSent() const {
+    return numItemsSent_;
+  }
+  // data items merged into another item by the TramCombiner
+  inline CmiUInt8 numItemsCombined() const {
+    return numItemsCombined_;
+  }
+  // messages sent for the given reason
+  inline CmiUInt8 numFlushes(TramFlushReason reason) const {
+    return numFlushes_[reason];
+  }
+  // average fraction of the buffer size filled in the buffers sent
+  inline double averageFill() const {
+    return numBuffersSent_ == 0 ? 0.0 :
+      (double) numBytesSent_ / ((double) numBuffersSent_ * bufferSize_);
+  }
+  // messages allocated rather than taken from the pool
+  inline CmiUInt8 numMessagesAllocated() const {
+    return numMessagesAllocated_;
+  }
+  // messages sent or received through the zero-copy API
+  inline CmiUInt8 numZeroCopyMessages() const {
+    return numZeroCopyMessages_;
+  }
 
   void sendMeshStreamerMessage(MeshStreamerMessageV *destinationBuffer,
-                               int dimension, int destinationIndex);
+                               int dimension, int destinationIndex,
+                               TramFlushReason reason);
 
   void registerPeriodicProgressFunction();
 
@@ -333,6 +566,7 @@ public:
       CkPrintf("[%d] All done. Reducing to final callback ...\n", myIndex_);
 #endif
       CkAssert(numDataItemsBuffered_ == 0);
+      CkAssert(bufferedBytes_ == 0);
       isPeriodicFlushEnabled_ = false;
       if (!userCallback_.isInvalid()) {
         this->contribute(userCallback_);
@@ -406,6 +640,25 @@ ctorHelper(int maxNumDataItemsBuffered, int numDimensions,
     dataBuffers_[i].assign(myRouter_.numBuffersPerDimension(i),
                            (MeshStreamerMessageV *) NULL);
   }
+  if (TramCombiner<dtype>::enabled) {
+    combineIndex_.resize(numDimensions_);
+    for (int i = 0; i < numDimensions; i++) {
+      combineIndex_[i].resize(myRouter_.numBuffersPerDimension(i));
+    }
+  }
+  numItemsSent_ = 0;
+  numItemsCombined_ = 0;
+  bufferedBytes_ = 0;
+  std::fill(numFlushes_, numFlushes_ + TRAM_NUM_FLUSH_REASONS, 0);
+  numBytesSent_ = 0;
+  numBuffersSent_ = 0;
+  maxPooledMessages_ = 2 * maxNumBuffers;
+  numMessagesAllocated_ = 0;
+  numZeroCopyMessages_ = 0;
+  zeroCopyThreshold_ = _tramZeroCopyThreshold;
+  zeroCopySentCb_ =
+    CkCallback(CkIndex_MeshStreamer<dtype, RouterType>::zeroCopySent(NULL),
+               this->thisProxy[myIndex_]);
 
   // a bufferSize input of 0 indicates it should be calculated by the library
   if (bufferSize_ == 0) {
@@ -431,6 +684,16 @@ ctorHelper(int maxNumDataItemsBuffered, int numDimensions,
   isPeriodicFlushEnabled_ = false;
   detectorLocalObj_ = NULL;
 
+  adaptiveFlush_ = false;
+  idleProgressRegistered_ = false;
+  latencyBudgetMs_ = _tramLatencyBudgetMs;
+  memoryCap_ = 0;
+  bufferState_.resize(numDimensions_);
+  for (int i = 0; i < numDimensions; i++) {
+    TramBufferState initial = {0.0, maxThreshold(), maxThreshold(), 0, 0.0};
+    bufferState_[i].assign(myRouter_.numBuffersPerDimension(i), initial);
+  }
+
 #ifdef CMK_TRAM_VERBOSE_OUTPUT
   CkPrintf("[%d] Instance initialized. Buffer size: %d, Capacity: %d, "
            "Yield: %d, Flush period: %f, Maximum number of buffers: %d\n",
@@ -469,9 +732,38 @@ copyDataIntoMessage(MeshStreamerMessageV *destinationBuffer,
 template <class dtype, class RouterType>
 inline void MeshStreamer<dtype, RouterType>::
 sendMeshStreamerMessage(MeshStreamerMessageV *destinationBuffer,
-                        int dimension, int destinationIndex) {
+                        int dimension, int destinationIndex,
+                        TramFlushReason reason) {
 
+  int numBytes =
+    destinationBuffer->template getoffset<dtype>(destinationBuffer->numDataItems);
+  bufferedBytes_ -= numBytes;
+  numFlushes_[reason]++;
+  if (destinationBuffer->numDataItems > 0) {
+    numBytesSent_ += numBytes;
+    numBuffersSent_++;
+  }
+  if (destinationIndex != myIndex_) {
+    numItemsSent_ += destinationBuffer->numDataItems;
+  }
   bool personalizedMessage = myRouter_.isMessagePersonalized(dimension);
+  if (zeroCopyThreshold_ >= 0 && numBytes >= zeroCopyThreshold_ &&
+      destinationIndex != myIndex_ && myRouter_.isFinalHop(dimension) &&
+      isStandardMessage(destinationBuffer)) {
+    // the arrays lie one after the other from destinationPes on, with the
+    // data items last; the destination pulls them up to the last item
+    // straight into a message from its pool, and this one is reused once
+    // it has
+    char *body = (char *) destinationBuffer->destinationPes;
+    int size = destinationBuffer->dataItems + numBytes - body;
+    zeroCopyMessages_[body] = destinationBuffer;
+    numZeroCopyMessages_++;
+    this->thisProxy[destinationIndex].receiveZeroCopy(
+      destinationBuffer->msgType, destinationBuffer->finalMsgCount,
+      destinationBuffer->numDataItems, personalizedMessage, size,
+      CkSendBuffer(body, zeroCopySentCb_));
+    return;
+  }
   if (personalizedMessage) {
 #ifdef CMK_TRAM_VERBOSE_OUTPUT
     CkPrintf("[%d] sending to %d\n", myIndex_, destinationIndex);
@@ -505,36 +797,55 @@ storeMessageIntermed(int destinationPe, const Route& destinationRoute,
     if (personalizedMessage) {
       numDestIndices = 0;
     }
-    if (!is_PUPbytes<dtype>::value) {
-      messageBuffers[bufferIndex] =
-        new (numDestIndices, numDestIndices, numDestIndices+1, numDestIndices, bufferSize_, 8 * sizeof(int))
-        MeshStreamerMessageV(myRouter_.determineMsgType(dimension),is_PUPbytes<dtype>::value);
-    }
-    else {
-      messageBuffers[bufferIndex] =
-        new (numDestIndices, numDestIndices, 0, numDestIndices, bufferSize_, 8 * sizeof(int))
-        MeshStreamerMessageV(myRouter_.determineMsgType(dimension),is_PUPbytes<dtype>::value);
-    }
-
-    *(int *) CkPriorityPtr(messageBuffers[bufferIndex]) = prio_;
-    CkSetQueueing(messageBuffers[bufferIndex], CK_QUEUEING_IFIFO);
+    int dataSize = startBuffer(dimension, bufferIndex);
+    messageBuffers[bufferIndex] =
+      newMessage(dimension, numDestIndices, dataSize);
     CkAssert(messageBuffers[bufferIndex] != NULL);
   }
 
   MeshStreamerMessageV *destinationBuffer = messageBuffers[bufferIndex];
+  if (TramCombiner<dtype>::enabled) {
+    dtype item;
+    if (is_PUPbytes<dtype>::value) {
+      item = *reinterpret_cast<dtype *>(dataItem);
+    }
+    else {
+      PUP::fromMemBuf(item, dataItem, size);
+    }
+    if (combineItem(destinationBuffer, combineIndex_[dimension][bufferIndex],
+                    destinationPe, arrayId, item)) {
+      return;
+    }
+  }
   int numBuffered =
     copyDataIntoMessage(destinationBuffer, dataItem, size, arrayId);
   if (!personalizedMessage) {
     destinationBuffer->markDestination(numBuffered-1, destinationPe);
   }
   numDataItemsBuffered_++;
+  bufferedBytes_ += size;
+
+  int numBytes =
+    destinationBuffer->template getoffset<dtype>(destinationBuffer->numDataItems);
+  bool isFull;
+  if (adaptiveFlush_) {
+    TramBufferState &state = bufferState_[dimension][bufferIndex];
+    state.arrivedBytes += size;
+    isFull = numBytes >= state.threshold;
+    if (isFull) {
+      bufferFilled(dimension, bufferIndex, numBytes);
+    }
+  }
+  else {
+    isFull = numBytes >
+      (thresholdFractionNumerator*(bufferSize_/thresholdFractionDenominator));
+  }
 
   // send if buffer is full
-  if (numBuffered == maxItemsBuffered || destinationBuffer->template getoffset<dtype>(destinationBuffer->numDataItems)
-      > (thresholdFractionNumerator*(bufferSize_/thresholdFractionDenominator))) {
+  if (numBuffered == maxItemsBuffered || isFull) {
 
     sendMeshStreamerMessage(destinationBuffer, dimension,
-                            destinationRoute.destinationPe);
+                            destinationRoute.destinationPe, TRAM_FLUSH_FULL);
     if (useStagedCompletion_) {
       cntMsgSent_[dimension][bufferIndex]++;
     }
@@ -544,7 +855,8 @@ storeMessageIntermed(int destinationPe, const Route& destinationRoute,
 
   }
   // send if total buffering capacity has been reached
-  else if (numDataItemsBuffered_ == maxNumDataItemsBuffered_) {
+  else if (numDataItemsBuffered_ == maxNumDataItemsBuffered_ ||
+           (memoryCap_ > 0 && bufferedBytes_ >= memoryCap_)) {
     sendLargestBuffer();
     hasSentRecently_ = true;
   }
@@ -560,21 +872,14 @@ storeMessage(int destinationPe, const Route& destinationRoute,
     = dataBuffers_[dimension];
 
   bool personalizedMessage = myRouter_.isMessagePersonalized(dimension);
-  if (PUP::size(const_cast<dtype&>(*(dataItem->dataItem))) > (cutoffFractionNumerator*(bufferSize_/cutoffFractionDenominator))) {
-    MeshStreamerMessageV* msg;
-    if (!is_PUPbytes<dtype>::value) {
-      msg =
-        new (1, 1, 2, 1, bufferSize_, 8 * sizeof(int))
-        MeshStreamerMessageV(myRouter_.determineMsgType(dimension),is_PUPbytes<dtype>::value);
-    }
-    else {
-      msg =
-        new (1, 1, 0, 1, bufferSize_, 8 * sizeof(int))
-        MeshStreamerMessageV(myRouter_.determineMsgType(dimension),is_PUPbytes<dtype>::value);
-    }
-    *(int *) CkPriorityPtr(msg) = prio_;
-    CkSetQueueing(msg, CK_QUEUEING_IFIFO);
+  int size = PUP::size(const_cast<dtype&>(*(dataItem->dataItem)));
+  if (size > cutoffBytes()) {
+    MeshStreamerMessageV* msg = newMessage(dimension, 1, size);
     copyDataItemIntoMessage(msg,dataItem,copyIndirectly);
+    numFlushes_[TRAM_FLUSH_LARGE_ITEM]++;
+    if (destinationPe != myIndex_) {
+      numItemsSent_++;
+    }
     this->thisProxy[destinationPe].receiveAtDestination(msg);
     return;
   }
@@ -586,35 +891,46 @@ storeMessage(int destinationPe, const Route& destinationRoute,
     if (personalizedMessage) {
       numDestIndices = 0;
     }
-    if (!is_PUPbytes<dtype>::value) {
-      messageBuffers[bufferIndex] =
-        new (numDestIndices, numDestIndices, numDestIndices+1, numDestIndices, bufferSize_, 8 * sizeof(int))
-        MeshStreamerMessageV(myRouter_.determineMsgType(dimension),is_PUPbytes<dtype>::value);
-    }
-    else {
-      messageBuffers[bufferIndex] =
-        new (numDestIndices, numDestIndices, 0, numDestIndices, bufferSize_, 8 * sizeof(int))
-        MeshStreamerMessageV(myRouter_.determineMsgType(dimension),is_PUPbytes<dtype>::value);
-    }
-
-    *(int *) CkPriorityPtr(messageBuffers[bufferIndex]) = prio_;
-    CkSetQueueing(messageBuffers[bufferIndex], CK_QUEUEING_IFIFO);
+    int dataSize = startBuffer(dimension, bufferIndex);
+    messageBuffers[bufferIndex] =
+      newMessage(dimension, numDestIndices, dataSize);
     CkAssert(messageBuffers[bufferIndex] != NULL);
   }
 
   MeshStreamerMessageV *destinationBuffer = messageBuffers[bufferIndex];
+  if (TramCombiner<dtype>::enabled &&
+      combineItem(destinationBuffer, combineIndex_[dimension][bufferIndex],
+                  destinationPe, dataItem->arrayIndex,
+                  const_cast<dtype&>(*(dataItem->dataItem)))) {
+    return;
+  }
   int numBuffered =
     copyDataItemIntoMessage(destinationBuffer, dataItem, copyIndirectly);
   if (!personalizedMessage) {
     destinationBuffer->markDestination(numBuffered-1, destinationPe);
   }
   numDataItemsBuffered_++;
-  if (numBuffered == maxItemsBuffered || destinationBuffer->template getoffset<dtype>(destinationBuffer->numDataItems)
-      >= (cutoffFractionNumerator*(bufferSize_/cutoffFractionDenominator))) {
+  bufferedBytes_ += size;
+
+  int numBytes =
+    destinationBuffer->template getoffset<dtype>(destinationBuffer->numDataItems);
+  bool isFull;
+  if (adaptiveFlush_) {
+    TramBufferState &state = bufferState_[dimension][bufferIndex];
+    state.arrivedBytes += size;
+    isFull = numBytes >= state.threshold;
+    if (isFull) {
+      bufferFilled(dimension, bufferIndex, numBytes);
+    }
+  }
+  else {
+    isFull = numBytes >= cutoffBytes();
+  }
+  if (numBuffered == maxItemsBuffered || isFull) {
     // send if buffer is full
     //record number of data items sent here
     sendMeshStreamerMessage(destinationBuffer, dimension,
-                            destinationRoute.destinationPe);
+                            destinationRoute.destinationPe, TRAM_FLUSH_FULL);
     if (useStagedCompletion_) {
       cntMsgSent_[dimension][bufferIndex]++;
     }
@@ -622,13 +938,132 @@ storeMessage(int destinationPe, const Route& destinationRoute,
     numDataItemsBuffered_ -= numBuffered;
     hasSentRecently_ = true;
   }
-  else if (numDataItemsBuffered_ == maxNumDataItemsBuffered_) {
+  else if (numDataItemsBuffered_ == maxNumDataItemsBuffered_ ||
+           (memoryCap_ > 0 && bufferedBytes_ >= memoryCap_)) {
     // send if total buffering capacity has been reached
     sendLargestBuffer();
     hasSentRecently_ = true;
   }
 }
 
+// Set up the buffer for a new message and return the size of its data.
+// Under adaptive flushing the message only needs room for its threshold
+// plus one more item, as it is sent once it reaches the threshold.
+template <class dtype, class RouterType>
+inline int MeshStreamer<dtype, RouterType>::
+startBuffer(int dimension, int index) {
+  if (TramCombiner<dtype>::enabled) {
+    combineIndex_[dimension][index].clear();
+  }
+  if (!adaptiveFlush_) {
+    return bufferSize_;
+  }
+  TramBufferState &state = bufferState_[dimension][index];
+  state.firstItemTime = CkWallTimer();
+  state.threshold = state.target;
+  return std::min(bufferSize_, state.threshold + cutoffBytes());
+}
+
+// Allocate a message with room for numIndices items and dataSize bytes
+// of data, or take one of the standard shape from the pool if that is
+// large enough.
+template <class dtype, class RouterType>
+inline MeshStreamerMessageV *MeshStreamer<dtype, RouterType>::
+newMessage(int dimension, int numIndices, int dataSize) {
+  MeshStreamerMessageV *msg;
+  std::vector<MeshStreamerMessageV *> &pool = messagePool_[numIndices == 0];
+  if ((numIndices == 0 || numIndices == maxItemsBuffered) &&
+      dataSize > 0 && dataSize <= bufferSize_ && !pool.empty()) {
+    msg = pool.back();
+    pool.pop_back();
+    msg->reset(myRouter_.determineMsgType(dimension));
+  }
+  else {
+    if (!is_PUPbytes<dtype>::value) {
+      msg = new (numIndices, numIndices, numIndices+1, numIndices, dataSize, 8 * sizeof(int))
+        MeshStreamerMessageV(myRouter_.determineMsgType(dimension), false);
+    }
+    else {
+      msg = new (numIndices, numIndices, 0, numIndices, dataSize, 8 * sizeof(int))
+        MeshStreamerMessageV(myRouter_.determineMsgType(dimension), true);
+    }
+    msg->numIndices = numIndices;
+    msg->dataCapacity = dataSize;
+    numMessagesAllocated_++;
+  }
+  *(int *) CkPriorityPtr(msg) = prio_;
+  CkSetQueueing(msg, CK_QUEUEING_IFIFO);
+  return msg;
+}
+
+template <class dtype, class RouterType>
+inline bool MeshStreamer<dtype, RouterType>::
+isStandardMessage(const MeshStreamerMessageV *msg) const {
+  return msg->dataCapacity == bufferSize_ &&
+    (msg->numIndices == 0 || msg->numIndices == maxItemsBuffered);
+}
+
+// Keep a message that was delivered or sent for reuse, or free it
+template <class dtype, class RouterType>
+inline void MeshStreamer<dtype, RouterType>::
+recycleMessage(MeshStreamerMessageV *msg) {
+  if (isStandardMessage(msg)) {
+    std::vector<MeshStreamerMessageV *> &pool = messagePool_[msg->numIndices == 0];
+    if (pool.size() < maxPooledMessages_) {
+      pool.push_back(msg);
+      return;
+    }
+  }
+  delete msg;
+}
+
+// Merge dataItem into a buffered item with the same key for the same
+// destination, if there is one. The merged item counts as delivered.
+template <class dtype, class RouterType>
+inline bool MeshStreamer<dtype, RouterType>::
+combineItem(MeshStreamerMessageV *destinationBuffer,
+            TramCombineIndex &combineIndex, int destinationPe,
+            const CkArrayIndex &destinationObject, dtype &dataItem) {
+  TramCombineKey key;
+  key.destinationPe = destinationPe;
+  key.key = TramCombiner<dtype>::key(dataItem);
+  int numDataItems = destinationBuffer->numDataItems;
+  TramCombineIndex::iterator it = combineIndex.find(key);
+  if (it == combineIndex.end() ||
+      !(destinationBuffer->destObjects[it->second] == destinationObject)) {
+    // the item will be appended
+    combineIndex[key] = numDataItems;
+    return false;
+  }
+
+  int index = it->second;
+  if (is_PUPbytes<dtype>::value) {
+    dtype *buffered = reinterpret_cast<dtype *>(destinationBuffer->dataItems +
+                                                index * sizeof(dtype));
+    TramCombiner<dtype>::combine(*buffered, dataItem);
+  }
+  else {
+    std::uint16_t *offsets = destinationBuffer->offsets;
+    dtype buffered;
+    PUP::fromMemBuf(buffered, destinationBuffer->dataItems + offsets[index],
+                    offsets[index+1] - offsets[index]);
+    TramCombiner<dtype>::combine(buffered, dataItem);
+    size_t sz = PUP::size(buffered);
+    if (sz != offsets[index+1] - offsets[index]) {
+      combineIndex[key] = numDataItems;
+      return false;
+    }
+    PUP::toMemBuf(buffered, destinationBuffer->dataItems + offsets[index], sz);
+  }
+
+  numItemsCombined_++;
+  if (useCompletionDetection_) {
+    detectorLocalObj_->consume();
+  }
+  QdProcess(1);
+  return true;
+}
+
 template <class dtype, class RouterType>
 inline void MeshStreamer<dtype, RouterType>::createDetectors() {
   // No data items should be submitted when staged completion has begun
@@ -824,14 +1259,69 @@ receiveAlongRoute(MeshStreamerMessageV *msg) {
 #endif
   }
 
-  delete msg;
+  recycleMessage(msg);
+}
+
+// Receive the body of a message sent through the zero-copy API into a
+// message of the standard shape from the pool
+template <class dtype, class RouterType>
+void MeshStreamer<dtype, RouterType>::
+receiveZeroCopy(int &msgType, int &finalMsgCount, int &numDataItems,
+                bool &personalized, int &size, char *&body,
+                CkNcpyBufferPost *ncpyPost) {
+  MeshStreamerMessageV *msg = newMessage(0, personalized ? 0 : maxItemsBuffered,
+                                         bufferSize_);
+  body = (char *) msg->destinationPes;
+  zeroCopyMessages_[body] = msg;
+}
+
+template <class dtype, class RouterType>
+void MeshStreamer<dtype, RouterType>::
+receiveZeroCopy(int msgType, int finalMsgCount, int numDataItems,
+                bool personalized, int size, char *body) {
+  typename std::unordered_map<char *, MeshStreamerMessageV *>::iterator it =
+    zeroCopyMessages_.find(body);
+  CkAssert(it != zeroCopyMessages_.end());
+  MeshStreamerMessageV *msg = it->second;
+  zeroCopyMessages_.erase(it);
+  numZeroCopyMessages_++;
+
+  msg->msgType = msgType;
+  msg->finalMsgCount = finalMsgCount;
+  msg->numDataItems = numDataItems;
+  if (personalized) {
+    receiveAtDestination(msg);
+  }
+  else {
+    receiveAlongRoute(msg);
+  }
+}
+
+// The destination has pulled a message sent through the zero-copy API
+template <class dtype, class RouterType>
+void MeshStreamer<dtype, RouterType>::zeroCopySent(CkDataMsg *m) {
+  CkNcpyBuffer *src = (CkNcpyBuffer *) m->data;
+  typename std::unordered_map<char *, MeshStreamerMessageV *>::iterator it =
+    zeroCopyMessages_.find((char *) src->ptr);
+  CkAssert(it != zeroCopyMessages_.end());
+  recycleMessage(it->second);
+  zeroCopyMessages_.erase(it);
+  delete m;
+}
+
+template <class dtype, class RouterType>
+MeshStreamer<dtype, RouterType>::~MeshStreamer() {
+  for (int i = 0; i < 2; i++) {
+    for (int j = 0; j < messagePool_[i].size(); j++) {
+      delete messagePool_[i][j];
+    }
+  }
 }
 
 template <class dtype, class RouterType>
 inline void MeshStreamer<dtype, RouterType>::sendLargestBuffer() {
 
-  int flushDimension, flushIndex, maxSize, destinationIndex;
-  MeshStreamerMessageV *destinationBuffer;
+  int flushDimension, flushIndex, maxSize;
 
   for (int i = 0; i < numDimensions_; i++) {
     std::vector<MeshStreamerMessageV *> &messageBuffers = dataBuffers_[i];
@@ -847,33 +1337,38 @@ inline void MeshStreamer<dtype, RouterType>::sendLargestBuffer() {
     }
 
     if (maxSize > 0) {
+      sendBuffer(flushDimension, flushIndex, TRAM_FLUSH_CAPACITY);
+    }
+  }
+}
 
-      messageBuffers = dataBuffers_[flushDimension];
-      destinationBuffer = messageBuffers[flushIndex];
+template <class dtype, class RouterType>
+inline void MeshStreamer<dtype, RouterType>::
+sendBuffer(int dimension, int index, TramFlushReason reason) {
 
-      // not sending the full buffer, shrink the message size
-      envelope *env = UsrToEnv(destinationBuffer);
-      //env->shrinkUsersize((bufferSize_ -
-      //destinationBuffer->template getoffset<dtype>(destinationBuffer->numDataItems)));
-      numDataItemsBuffered_ -= destinationBuffer->numDataItems;
+  std::vector<MeshStreamerMessageV *> &messageBuffers = dataBuffers_[dimension];
+  MeshStreamerMessageV *destinationBuffer = messageBuffers[index];
 
-      destinationIndex =
-        myRouter_.nextPeAlongRoute(flushDimension, flushIndex);
-      
-      if (destinationIndex == myIndex_) {
-        destinationBuffer->finalMsgCount = -2;
-      }
-      
-      sendMeshStreamerMessage(destinationBuffer, flushDimension,
-        destinationIndex);
+  // not sending the full buffer, shrink the message size
+  envelope *env = UsrToEnv(destinationBuffer);
+  //env->shrinkUsersize((bufferSize_ -
+  //destinationBuffer->template getoffset<dtype>(destinationBuffer->numDataItems)));
+  numDataItemsBuffered_ -= destinationBuffer->numDataItems;
 
-      if (useStagedCompletion_ && destinationIndex != myIndex_) {
-        cntMsgSent_[i][flushIndex]++;
-      }
+  int destinationIndex = myRouter_.nextPeAlongRoute(dimension, index);
 
-      messageBuffers[flushIndex] = NULL;
-    }
+  if (destinationIndex == myIndex_) {
+    destinationBuffer->finalMsgCount = -2;
   }
+
+  sendMeshStreamerMessage(destinationBuffer, dimension, destinationIndex,
+                          reason);
+
+  if (useStagedCompletion_ && destinationIndex != myIndex_) {
+    cntMsgSent_[dimension][index]++;
+  }
+
+  messageBuffers[index] = NULL;
 }
 
 template <class dtype, class RouterType>
@@ -900,10 +1395,7 @@ flushDimension(int dimension, bool sendMsgCounts) {
       continue;
     }
     if(messageBuffers[j] == NULL && sendMsgCounts) {
-        messageBuffers[j] = new (0, 0, 1, 0, 0, 8 * sizeof(int))
-          MeshStreamerMessageV(myRouter_.determineMsgType(dimension), is_PUPbytes<dtype>::value);
-        *(int *) CkPriorityPtr(messageBuffers[j]) = prio_;
-        CkSetQueueing(messageBuffers[j], CK_QUEUEING_IFIFO);
+        messageBuffers[j] = newMessage(dimension, 0, 0);
     }
     else {
       // if not sending the full buffer, shrink the message size
@@ -929,7 +1421,9 @@ flushDimension(int dimension, bool sendMsgCounts) {
       }
       CkAssert(!sendMsgCounts || destinationBuffer->finalMsgCount != -1);
     }
-    sendMeshStreamerMessage(destinationBuffer, dimension, destinationIndex);
+    sendMeshStreamerMessage(destinationBuffer, dimension, destinationIndex,
+                            sendMsgCounts ? TRAM_FLUSH_COMPLETION :
+                            TRAM_FLUSH_PERIODIC);
     messageBuffers[j] = NULL;
   }
 }
@@ -946,12 +1440,112 @@ void MeshStreamer<dtype, RouterType>::flushIfIdle(){
       flushToIntermediateDestinations();
     }
     CkAssert(numDataItemsBuffered_ == 0);
+    CkAssert(bufferedBytes_ == 0);
 
   }
 
   hasSentRecently_ = false;
 }
 
+// Adaptive flushing: from the bytes that arrived for each buffer since the
+// last check, estimate the rate at which the buffer fills and size the
+// next message for it to fill within the latency budget, keeping the
+// total within the memory cap. Then send the buffers whose oldest item
+// has waited for the latency budget and, if the PE is idle, those not
+// expected to fill up before that.
+template <class dtype, class RouterType>
+void MeshStreamer<dtype, RouterType>::adaptiveProgress(bool idle) {
+
+  double now = CkWallTimer();
+  double elapsedMs = (now - lastProgressTime_) * 1000.0;
+  if (!idle && elapsedMs > 0) {
+    int minBytes = std::max(1, maxThreshold() / 16);
+    double totalBytes = 0;
+    lastProgressTime_ = now;
+    for (int i = 0; i < numDimensions_; i++) {
+      for (int j = 0; j < bufferState_[i].size(); j++) {
+        TramBufferState &state = bufferState_[i][j];
+        // keep the last estimate for peers nothing is sent to
+        if (state.arrivedBytes > 0 || dataBuffers_[i][j] != NULL) {
+          updateRate(state, state.arrivedBytes / elapsedMs);
+          state.arrivedBytes = 0;
+        }
+        totalBytes += state.target;
+      }
+    }
+    if (memoryCap_ > 0 && totalBytes > memoryCap_) {
+      double scale = memoryCap_ / totalBytes;
+      for (int i = 0; i < numDimensions_; i++) {
+        for (int j = 0; j < bufferState_[i].size(); j++) {
+          TramBufferState &state = bufferState_[i][j];
+          state.target = std::max(minBytes, (int) (state.target * scale));
+        }
+      }
+    }
+  }
+
+  if (numDataItemsBuffered_ == 0) {
+    return;
+  }
+  for (int i = 0; i < numDimensions_; i++) {
+    std::vector<MeshStreamerMessageV *> &messageBuffers = dataBuffers_[i];
+    for (int j = 0; j < messageBuffers.size(); j++) {
+      if (messageBuffers[j] == NULL || messageBuffers[j]->numDataItems == 0) {
+        continue;
+      }
+      const TramBufferState &state = bufferState_[i][j];
+      double waitedMs = (now - state.firstItemTime) * 1000.0;
+      if (waitedMs >= latencyBudgetMs_) {
+        sendBuffer(i, j, TRAM_FLUSH_LATENCY);
+      }
+      else if (idle) {
+        int numBytes = messageBuffers[j]->template getoffset<dtype>(
+                         messageBuffers[j]->numDataItems);
+        if (numBytes + state.byteRate * (latencyBudgetMs_ - waitedMs)
+            < state.threshold) {
+          sendBuffer(i, j, TRAM_FLUSH_IDLE);
+        }
+      }
+    }
+  }
+}
+
+template <class dtype, class RouterType>
+inline void MeshStreamer<dtype, RouterType>::
+updateRate(TramBufferState &state, double byteRate) {
+  int maxBytes = maxThreshold();
+  int minBytes = std::max(1, maxBytes / 16);
+  state.byteRate = 0.5 * (state.byteRate + byteRate);
+  state.target = std::max(minBytes, std::min(maxBytes,
+                   (int) (state.byteRate * latencyBudgetMs_)));
+}
+
+// A buffer reached its threshold: progress checks do not run while the
+// PE is busy inserting items, so also estimate the rate from how long the
+// buffer took to fill
+template <class dtype, class RouterType>
+inline void MeshStreamer<dtype, RouterType>::
+bufferFilled(int dimension, int index, int numBytes) {
+  TramBufferState &state = bufferState_[dimension][index];
+  double fillMs = std::max(1e-3, (CkWallTimer() - state.firstItemTime) * 1000.0);
+  updateRate(state, numBytes / fillMs);
+}
+
+template <class dtype, class RouterType>
+void MeshStreamer<dtype, RouterType>::
+enableAdaptiveFlushing(double latencyBudgetMs, int memoryCap) {
+
+  adaptiveFlush_ = true;
+  latencyBudgetMs_ = latencyBudgetMs > 0 ? latencyBudgetMs : 1.0;
+  memoryCap_ = memoryCap;
+  progressPeriodInMs_ = latencyBudgetMs_ / 4;
+  lastProgressTime_ = CkWallTimer();
+
+  isPeriodicFlushEnabled_ = true;
+  registerPeriodicProgressFunction();
+  registerIdleProgressFunction();
+}
+
 template <class dtype, class RouterType>
 void periodicProgressFunction(void *MeshStreamerObj, double time) {
 
@@ -959,11 +1553,43 @@ void periodicProgressFunction(void *MeshStreamerObj, double time) {
     static_cast<MeshStreamer<dtype, RouterType>*>(MeshStreamerObj);
 
   if (properObj->isPeriodicFlushEnabled()) {
-    properObj->flushIfIdle();
+    if (properObj->isAdaptiveFlushEnabled()) {
+      properObj->adaptiveProgress(false);
+    }
+    else {
+      properObj->flushIfIdle();
+    }
     properObj->registerPeriodicProgressFunction();
   }
 }
 
+template <class dtype, class RouterType>
+void idleProgressFunction(void *MeshStreamerObj) {
+
+  MeshStreamer<dtype, RouterType> *properObj =
+    static_cast<MeshStreamer<dtype, RouterType>*>(MeshStreamerObj);
+
+  properObj->idleProgress();
+}
+
+template <class dtype, class RouterType>
+void MeshStreamer<dtype, RouterType>::idleProgress() {
+  idleProgressRegistered_ = false;
+  if (isPeriodicFlushEnabled_ && adaptiveFlush_) {
+    adaptiveProgress(true);
+    registerIdleProgressFunction();
+  }
+}
+
+template <class dtype, class RouterType>
+void MeshStreamer<dtype, RouterType>::registerIdleProgressFunction() {
+  if (!idleProgressRegistered_) {
+    idleProgressRegistered_ = true;
+    CcdCallOnCondition(CcdPROCESSOR_BEGIN_IDLE,
+                       idleProgressFunction<dtype, RouterType>, (void *) this);
+  }
+}
+
 template <class dtype, class RouterType>
 void MeshStreamer<dtype, RouterType>::registerPeriodicProgressFunction() {
   CcdCallFnAfter(periodicProgressFunction<dtype, RouterType>, (void *) this,
@@ -988,6 +1614,33 @@ void MeshStreamer<dtype, RouterType>::pup(PUP::er &p) {
   p|detector_;
   p|prio_;
   p|yieldCount_;
+  p|numItemsSent_;
+  p|numItemsCombined_;
+  p|adaptiveFlush_;
+  p|latencyBudgetMs_;
+  p|memoryCap_;
+  p|bufferState_;
+  p|bufferedBytes_;
+  PUParray(p, numFlushes_, TRAM_NUM_FLUSH_REASONS);
+  p|numBytesSent_;
+  p|numBuffersSent_;
+  p|maxPooledMessages_;
+  p|numMessagesAllocated_;
+  p|numZeroCopyMessages_;
+  p|zeroCopyThreshold_;
+  if (p.isUnpacking()) {
+    zeroCopySentCb_ =
+      CkCallback(CkIndex_MeshStreamer<dtype, RouterType>::zeroCopySent(NULL),
+                 this->thisProxy[CkMyPe()]);
+    // timers are not comparable across processes
+    idleProgressRegistered_ = false;
+    lastProgressTime_ = CkWallTimer();
+    for (int i = 0; i < bufferState_.size(); i++) {
+      for (int j = 0; j < bufferState_[i].size(); j++) {
+        bufferState_[i][j].firstItemTime = lastProgressTime_;
+      }
+    }
+  }
 
   // only used for staged completion
   p|cntMsgSent_;
@@ -1029,6 +1682,15 @@ void MeshStreamer<dtype, RouterType>::pup(PUP::er &p) {
     }
   }
 
+  // buffered items are not indexed again after unpacking, they are just
+  // not combined with
+  if (p.isUnpacking() && TramCombiner<dtype>::enabled) {
+    combineIndex_.resize(outervec_size);
+    for (int i = 0; i < outervec_size; i++) {
+      combineIndex_[i].resize(innervec_sizes[i]);
+    }
+  }
+
   // pup each message element
   for (int i = 0; i < outervec_size; i++) {
     for (int j = 0; j < innervec_sizes[i]; j++) {
@@ -1062,7 +1724,7 @@ private:
       this->detectorLocalObj_->consume(msg->numDataItems);
     }
     QdProcess(msg->numDataItems);
-    delete msg;
+    this->recycleMessage(msg);
   }
 
   inline void localDeliver(const char* data, size_t size, CkArrayIndex arrayId,
@@ -1220,7 +1882,7 @@ public:
       this->markMessageReceived(msg->msgType, msg->finalMsgCount);
     }
 
-    delete msg;
+    this->recycleMessage(msg);
   }
   template <bool deliverInline = false>
   inline void insertData(const dtype& dataItem, CkArrayIndex arrayIndex) {
@@ -1367,6 +2029,266 @@ public:
   }
 
 };
+// Aggregation into buffers shared by all PEs of a process, one per
+// destination node, for group clients and fixed-size data items. Any PE
+// of the node inserts through the local branch (ckLocalBranch() of the
+// proxy), taking a slot with an atomic increment; a PE that finds the
+// buffer full waits while it is sent. Full buffers go straight to a PE of the
+// destination node, which hands each other PE its items. Completion is
+// left to quiescence detection: flush() sends what is buffered.
+template <class dtype, class ClientType, int (*EntryMethod)(char *, void *) = defaultMeshStreamerDeliver<dtype, ClientType> >
+class NodeGroupMeshStreamer :
+  public CBase_NodeGroupMeshStreamer<dtype, ClientType, EntryMethod> {
+  static_assert(is_PUPbytes<dtype>::value,
+                "NodeGroupMeshStreamer only handles fixed-size data items");
+private:
+  CkGroupID clientGID_;
+  int bufferCapacity_;           // data items per buffer
+  double progressPeriodInMs_;
+  bool isPeriodicFlushEnabled_;
+  std::atomic<bool> hasSentRecently_;
+  std::vector<TramNodeBuffer> buffers_;
+
+  std::atomic<CmiUInt8> numItemsSent_;
+  std::atomic<CmiUInt8> numBuffersSent_;
+  std::atomic<CmiUInt8> numFlushes_[TRAM_NUM_FLUSH_REASONS];
+
+  MeshStreamerMessageV *newMessage();
+  void sendBuffer(int node);
+  void flush(TramFlushReason reason);
+
+public:
+  NodeGroupMeshStreamer(CkGroupID clientGID, int bufferSize,
+                        double progressPeriodInMs);
+  ~NodeGroupMeshStreamer();
+
+  inline void insertData(const dtype& dataItem, int destinationPe);
+  // send the partially filled buffers
+  void flush() {
+    flush(TRAM_FLUSH_COMPLETION);
+  }
+
+  // entry methods
+  void receiveAtNode(MeshStreamerMessageV *msg);
+  void enablePeriodicFlushing();
+
+  static void periodicProgressFunction(void *obj, double time);
+  static void deliverOnRank(void *obj, TramNodeDeliveryMsg *msg);
+
+  // data items sent to any PE, including those of this node
+  inline CmiUInt8 numItemsSent() const {
+    return numItemsSent_;
+  }
+  // messages sent for the given reason
+  inline CmiUInt8 numFlushes(TramFlushReason reason) const {
+    return numFlushes_[reason];
+  }
+  // average fraction of the buffer capacity filled in the buffers sent
+  inline double averageFill() const {
+    return numBuffersSent_ == 0 ? 0.0 :
+      (double) numItemsSent_ / ((double) numBuffersSent_ * bufferCapacity_);
+  }
+  // one message per destination node plus one for each sent
+  inline CmiUInt8 numMessagesAllocated() const {
+    return buffers_.size() + numBuffersSent_;
+  }
+};
+
+template <class dtype, class ClientType, int (*EntryMethod)(char *, void *)>
+NodeGroupMeshStreamer<dtype, ClientType, EntryMethod>::
+NodeGroupMeshStreamer(CkGroupID clientGID, int bufferSize,
+                      double progressPeriodInMs)
+  : buffers_(CkNumNodes()) {
+  clientGID_ = clientGID;
+  bufferCapacity_ = std::max(1, bufferSize / (int) sizeof(dtype));
+  progressPeriodInMs_ = progressPeriodInMs;
+  isPeriodicFlushEnabled_ = false;
+  hasSentRecently_ = false;
+  for (int i = 0; i < buffers_.size(); i++) {
+    buffers_[i].reserved = 0;
+    buffers_[i].written = 0;
+    buffers_[i].limit = bufferCapacity_;
+    buffers_[i].msg = newMessage();
+  }
+  numItemsSent_ = 0;
+  numBuffersSent_ = 0;
+  for (int i = 0; i < TRAM_NUM_FLUSH_REASONS; i++) {
+    numFlushes_[i] = 0;
+  }
+}
+
+template <class dtype, class ClientType, int (*EntryMethod)(char *, void *)>
+NodeGroupMeshStreamer<dtype, ClientType, EntryMethod>::~NodeGroupMeshStreamer() {
+  for (int i = 0; i < buffers_.size(); i++) {
+    delete buffers_[i].msg;
+  }
+}
+
+template <class dtype, class ClientType, int (*EntryMethod)(char *, void *)>
+inline MeshStreamerMessageV *
+NodeGroupMeshStreamer<dtype, ClientType, EntryMethod>::newMessage() {
+  MeshStreamerMessageV *msg =
+    new (bufferCapacity_, 0, 0, 0, bufferCapacity_ * sizeof(dtype))
+    MeshStreamerMessageV(0, true);
+  msg->numIndices = bufferCapacity_;
+  msg->dataCapacity = bufferCapacity_ * sizeof(dtype);
+  return msg;
+}
+
+template <class dtype, class ClientType, int (*EntryMethod)(char *, void *)>
+inline void NodeGroupMeshStreamer<dtype, ClientType, EntryMethod>::
+insertData(const dtype& dataItem, int destinationPe) {
+  QdCreate(1);
+
+  int node = CkNodeOf(destinationPe);
+  TramNodeBuffer &buffer = buffers_[node];
+  int slot;
+  while ((slot = buffer.reserved.fetch_add(1, std::memory_order_acquire))
+         >= bufferCapacity_) {
+    // the buffer is being sent, wait for the next one
+    for (int round = 0;
+         buffer.reserved.load(std::memory_order_acquire) >= bufferCapacity_;
+         round++) {
+      tramNodeBackoff(round);
+    }
+  }
+  MeshStreamerMessageV *msg = buffer.msg;
+  msg->markDestination(slot, destinationPe);
+  std::memcpy(msg->dataItems + slot * sizeof(dtype), &dataItem, sizeof(dtype));
+  if (buffer.written.fetch_add(1, std::memory_order_acq_rel) + 1
+      == bufferCapacity_) {
+    sendBuffer(node);
+  }
+}
+
+// Called by the thread that completed the buffer, with all its slots
+// written or given up by a flush
+template <class dtype, class ClientType, int (*EntryMethod)(char *, void *)>
+void NodeGroupMeshStreamer<dtype, ClientType, EntryMethod>::sendBuffer(int node) {
+  TramNodeBuffer &buffer = buffers_[node];
+  MeshStreamerMessageV *msg = buffer.msg;
+  int numDataItems = buffer.limit;
+
+  buffer.msg = newMessage();
+  buffer.limit = bufferCapacity_;
+  buffer.written.store(0, std::memory_order_relaxed);
+  buffer.reserved.store(0, std::memory_order_release);
+
+  if (numDataItems == bufferCapacity_) {
+    numFlushes_[TRAM_FLUSH_FULL]++;
+  }
+  msg->numDataItems = numDataItems;
+  numItemsSent_ += numDataItems;
+  numBuffersSent_++;
+  hasSentRecently_ = true;
+  this->thisProxy[node].receiveAtNode(msg);
+}
+
+template <class dtype, class ClientType, int (*EntryMethod)(char *, void *)>
+void NodeGroupMeshStreamer<dtype, ClientType, EntryMethod>::
+flush(TramFlushReason reason) {
+  for (int i = 0; i < buffers_.size(); i++) {
+    TramNodeBuffer &buffer = buffers_[i];
+    int numReserved = buffer.reserved.load(std::memory_order_acquire);
+    // leave empty buffers and those already being sent alone
+    while (numReserved > 0 && numReserved < bufferCapacity_ &&
+           !buffer.reserved.compare_exchange_weak(numReserved, bufferCapacity_,
+                                                  std::memory_order_acq_rel)) {
+    }
+    if (numReserved <= 0 || numReserved >= bufferCapacity_) {
+      continue;
+    }
+    numFlushes_[reason]++;
+    buffer.limit = numReserved;
+    int numGivenUp = bufferCapacity_ - numReserved;
+    if (buffer.written.fetch_add(numGivenUp, std::memory_order_acq_rel)
+        + numGivenUp == bufferCapacity_) {
+      sendBuffer(i);
+    }
+  }
+}
+
+// Deliver the items for this PE and push those for the other PEs of the
+// node onto their queues
+template <class dtype, class ClientType, int (*EntryMethod)(char *, void *)>
+void NodeGroupMeshStreamer<dtype, ClientType, EntryMethod>::
+receiveAtNode(MeshStreamerMessageV *msg) {
+  int myRank = CkMyRank();
+  std::vector<int> numForRank(CkMyNodeSize(), 0);
+  for (int i = 0; i < msg->numDataItems; i++) {
+    numForRank[CkRankOf(msg->destinationPes[i])]++;
+  }
+
+  std::vector<TramNodeDeliveryMsg *> rankMsgs(CkMyNodeSize(), NULL);
+  for (int r = 0; r < rankMsgs.size(); r++) {
+    if (r != myRank && numForRank[r] > 0) {
+      rankMsgs[r] = (TramNodeDeliveryMsg *)
+        CmiAlloc(sizeof(TramNodeDeliveryMsg) + numForRank[r] * sizeof(dtype));
+      CmiSetHandler(rankMsgs[r], CpvAccess(_tramNodeDeliveryHandlerIdx));
+      rankMsgs[r]->deliver = deliverOnRank;
+      rankMsgs[r]->streamer = this;
+      rankMsgs[r]->numDataItems = 0;
+    }
+  }
+  for (int i = 0; i < msg->numDataItems; i++) {
+    TramNodeDeliveryMsg *rankMsg = rankMsgs[CkRankOf(msg->destinationPes[i])];
+    if (rankMsg != NULL) {
+      std::memcpy((char *) (rankMsg + 1) + rankMsg->numDataItems++ * sizeof(dtype),
+                  msg->dataItems + i * sizeof(dtype), sizeof(dtype));
+    }
+  }
+  for (int r = 0; r < rankMsgs.size(); r++) {
+    if (rankMsgs[r] != NULL) {
+      CmiPushPE(r, rankMsgs[r]);
+    }
+  }
+
+  if (numForRank[myRank] > 0) {
+    void *clientObj = CkLocalBranch(clientGID_);
+    for (int i = 0; i < msg->numDataItems; i++) {
+      if (CkRankOf(msg->destinationPes[i]) == myRank) {
+        EntryMethod(msg->dataItems + i * sizeof(dtype), clientObj);
+      }
+    }
+    QdProcess(numForRank[myRank]);
+  }
+  delete msg;
+}
+
+template <class dtype, class ClientType, int (*EntryMethod)(char *, void *)>
+void NodeGroupMeshStreamer<dtype, ClientType, EntryMethod>::
+deliverOnRank(void *obj, TramNodeDeliveryMsg *msg) {
+  NodeGroupMeshStreamer *streamer = static_cast<NodeGroupMeshStreamer *>(obj);
+  void *clientObj = CkLocalBranch(streamer->clientGID_);
+  char *dataItems = (char *) (msg + 1);
+  for (int i = 0; i < msg->numDataItems; i++) {
+    EntryMethod(dataItems + i * sizeof(dtype), clientObj);
+  }
+  QdProcess(msg->numDataItems);
+}
+
+// Flushes run on the PE this is called on; a flush only happens if no
+// buffer was sent from the node during the preceding period
+template <class dtype, class ClientType, int (*EntryMethod)(char *, void *)>
+void NodeGroupMeshStreamer<dtype, ClientType, EntryMethod>::
+enablePeriodicFlushing() {
+  if (progressPeriodInMs_ <= 0 || isPeriodicFlushEnabled_) {
+    return;
+  }
+  isPeriodicFlushEnabled_ = true;
+  CcdCallFnAfter(periodicProgressFunction, (void *) this, progressPeriodInMs_);
+}
+
+template <class dtype, class ClientType, int (*EntryMethod)(char *, void *)>
+void NodeGroupMeshStreamer<dtype, ClientType, EntryMethod>::
+periodicProgressFunction(void *obj, double time) {
+  NodeGroupMeshStreamer *streamer = static_cast<NodeGroupMeshStreamer *>(obj);
+  if (!streamer->hasSentRecently_.exchange(false)) {
+    streamer->flush(TRAM_FLUSH_PERIODIC);
+  }
+  CcdCallFnAfter(periodicProgressFunction, obj, streamer->progressPeriodInMs_);
+}
+
 template <typename dtype, typename RouterType>
 struct recursive_pup_impl<MeshStreamer<dtype, RouterType>, 1> {
   typedef MeshStreamer<dtype, RouterType> T;
@@ -118,6 +118,7 @@ public:
   //   inline int maxNumAllocatedBuffers();
   //   inline int numMsgTypes();
   //   inline bool isMessagePersonalized(int dimension);
+  //   inline bool isFinalHop(int dimension);
   //   inline int dimensionReceived(int msgType);
   //   inline int determineMsgType(int dimension);
   //   inline bool isBufferInUse(int dimension, int index);
@@ -247,6 +248,17 @@ public:
     return false;
   }
 
+  // items are routed along the lowest dimension last, so they reach their
+  // destination when sent along a dimension with only trivial ones below
+  inline bool isFinalHop(int dimension) {
+    for (int i = 0; i < dimension; i++) {
+      if (this->individualDimensionSizes_[i] > 1) {
+        return false;
+      }
+    }
+    return true;
+  }
+
   inline int dimensionReceived(int msgType) {
     // for MeshRouter, the type of the message is the dimension
     return msgType;
@@ -471,6 +483,10 @@ public:
       dimension == numDimensions_ - 1 && myAssignedDim_ == numDimensions_ - 1;
   }
 
+  inline bool isFinalHop(int dimension) {
+    return isMessagePersonalized(dimension);
+  }
+
   inline int dimensionReceived(int msgType) {
     CkAssert(msgType == forwardMsgType);
     return dimensionOfArrivingMsgs_;
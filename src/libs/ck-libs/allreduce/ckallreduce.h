@@ -0,0 +1,146 @@
+#ifndef CKALLREDUCE_H
+#define CKALLREDUCE_H
+
+#include <map>
+#include <vector>
+
+#include "CkAllreduce.decl.h"
+
+/*
+  Bandwidth-optimal reduce-scatter and allreduce for the elements of a
+  chare array or the branches of a group.
+
+  contribute() followed by a broadcast moves the whole vector up and down
+  the spanning tree, so every tree level carries the full payload. Here
+  each PE first combines its local contributions, then the PEs run a
+  reduce-scatter over CkNumPes() blocks of the data, after which PE p
+  holds the fully reduced block p. An allreduce follows that with an
+  allgather of the blocks. Every PE sends and receives about one copy of
+  the data in each phase, however many PEs there are.
+
+  Two schedules are provided: a ring (CkNumPes()-1 steps per phase, each
+  PE only talks to its neighbours) and recursive halving/doubling (log2
+  steps per phase, power-of-two PE counts only). Any element-wise reducer
+  works, i.e. one registered with a segment unit: all the built-in sum,
+  product, max, min, logical and bitvec reducers, and custom reducers
+  passed to CkReduction::addReducer with a segmentUnit.
+
+  Every contributor calls allreduce() or reduceScatter() once per round,
+  on the local branch, with the same size and reducer everywhere. The
+  result is delivered to the callback of each contributor, on the
+  contributor's PE. For reduceScatter() that is the block owned by the
+  contributor's PE; blockRange() tells where it lies in the full vector.
+  Elements of a bound array must not be created, destroyed or migrated
+  while a round is in progress. A PE does not take part in a round until
+  its branch of the bound array exists and insertion has finished there,
+  so an array with dynamic insertion needs doneInserting() before its
+  elements' contributions can complete a round.
+*/
+
+// Listens on the local branch of a CkAllreduceMgr's bound array, and starts
+// the rounds waiting for insertion to finish once it has
+class CkAllreduceListener : public CkArrayListener
+{
+  CkGroupID mgr;
+
+public:
+  CkAllreduceListener(CkGroupID mgr_) : CkArrayListener(0), mgr(mgr_) {}
+  CkAllreduceListener(CkMigrateMessage* m) : CkArrayListener(m) {}
+  void pup(PUP::er& p)
+  {
+    CkArrayListener::pup(p);
+    p | mgr;
+  }
+  PUPable_decl(CkAllreduceListener);
+
+  void ckEndInserting(void);
+};
+
+// One block of the data, on its way between PEs or held by one
+class CkAllreduceBlockMsg : public CMessage_CkAllreduceBlockMsg
+{
+public:
+  int redNo;    // the round
+  int step;     // the step of the round it is sent in
+  int block;    // the block index
+  int reducer;
+  bool gather;  // part of an allreduce rather than a reduce-scatter
+  int size;     // bytes of data, 0 for a PE without local contributors
+  char* data;
+};
+
+class CkAllreduceMgr : public CBase_CkAllreduceMgr
+{
+public:
+  enum Algorithm
+  {
+    AUTO,               // recursive halving on power-of-two PE counts, else ring
+    RING,
+    RECURSIVE_HALVING
+  };
+
+  // One contribution per PE per round, e.g. from the branches of a group
+  CkAllreduceMgr(int algorithm);
+  // One contribution per local element of boundArray per round
+  CkAllreduceMgr(CkArrayID boundArray, int algorithm);
+  CkAllreduceMgr(CkMigrateMessage* m) : CBase_CkAllreduceMgr(m) {}
+  ~CkAllreduceMgr();
+
+  // Local methods
+  void allreduce(int dataSize, const void* data, CkReduction::reducerType type,
+                 const CkCallback& cb);
+  void reduceScatter(int dataSize, const void* data, CkReduction::reducerType type,
+                     const CkCallback& cb);
+
+  // Byte offset and length of the block of a dataSize-byte vector that a
+  // reduceScatter() delivers on pe
+  static void blockRange(int dataSize, CkReduction::reducerType type, int pe, int& offset,
+                         int& size);
+  // Start the rounds that wait for the number of local contributors
+  void startWaitingRounds();
+
+  // Entry methods
+  void recvBlock(CkAllreduceBlockMsg* m);
+  void listen();
+
+private:
+  struct Round
+  {
+    int nSteps;     // reduce-scatter steps, doubled for an allreduce
+    int step;       // current step
+    int pending;    // blocks still to arrive for the current step
+    bool started;   // local contributions combined and split into blocks
+    bool sent;      // the current step's blocks have been sent
+    bool gather;    // allreduce: follow the reduce-scatter with an allgather
+    CkReduction::reducerType reducer;
+    std::vector<CkReductionMsg*> contributions;
+    std::vector<CkCallback> callbacks;
+    std::vector<CkAllreduceBlockMsg*> blocks;  // this PE's partial or final blocks
+    std::vector<CkAllreduceBlockMsg*> early;   // blocks for a later step
+
+    Round() : nSteps(0), step(0), pending(0), started(false), sent(false),
+              gather(false), reducer(CkReduction::invalid) {}
+  };
+
+  CkArrayID boundArray;
+  bool halving;
+  int nextRound;                 // round of the next local contribution
+  std::map<int, Round> rounds;
+
+  void init(int algorithm);
+  void addContribution(int dataSize, const void* data, CkReduction::reducerType type,
+                       const CkCallback& cb, bool gather);
+  int localContributors() const;
+  void tryStart(int redNo, Round& r);
+  void start(int redNo, Round& r);
+  void advance(int redNo, Round& r);
+  void sendStep(int redNo, Round& r);
+  void receive(Round& r, CkAllreduceBlockMsg* m);
+  void finish(Round& r);
+
+  // Schedule of one step: count blocks from sendFirst on go to sendTo, and
+  // as many arrive from the same or (ring) the previous PE
+  void stepPlan(const Round& r, int step, int& sendTo, int& sendFirst, int& count) const;
+};
+
+#endif
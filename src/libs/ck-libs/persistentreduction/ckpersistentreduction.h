@@ -0,0 +1,148 @@
+#ifndef CKPERSISTENTREDUCTION_H
+#define CKPERSISTENTREDUCTION_H
+
+#include <unordered_map>
+#include <vector>
+
+#include "CkPersistentReduction.decl.h"
+
+/*
+  A reduction channel for programs that reduce the same shape of data
+  every iteration: the same reducer, the same number of bytes and the
+  same callback.
+
+  contribute() builds a message per contribution and the reduction
+  manager keeps general state per reduction. A CkPersistentReduction
+  fixes the reducer, size and callback when it is created, and
+  allocates its buffers up front with CkRdmaAlloc: on each PE, one to
+  combine a round's local contributions and children's results in, and
+  one per child of the spanning tree to receive into, two rounds' worth
+  of each. Contributions are folded straight from the caller's data into
+  the combine buffer, and the buffers are reused from round to round;
+  more only get allocated when more rounds than that overlap on a PE.
+
+  Partial results go up a topology-aware spanning tree of the PEs.
+  Results of at least zcThreshold bytes travel through the zero-copy
+  entry method API, so the parent pulls them straight into one of its
+  receive buffers; smaller ones (or all, if zcThreshold is negative) are
+  copied into an ordinary message. The root combines straight into the
+  CkReductionMsg delivered to the callback, the one message a round
+  allocates there.
+
+  The reducer must have a fold function, like all the built-in
+  element-wise reducers (see CkReduction::addReducer). Every contributor
+  calls contribute() once per round, on the local branch; elements of a
+  bound array pass themselves. Rounds are counted per contributor: each
+  contribution of an element goes to the round after its previous one,
+  however far it runs ahead of the other elements. Elements of a bound
+  array may only be created, destroyed or migrated between rounds, e.g.
+  at a load balancing step, once every contribution to a round has been
+  made and none to the next. An element created on or arriving at a PE
+  starts at the round after the last one that PE has taken part in. A PE
+  passes no round on until its branch of the bound array exists and
+  insertion has finished there, so an array with dynamic insertion needs
+  doneInserting() before its rounds can complete.
+*/
+
+// Listens on the local branch of a CkPersistentReduction's bound array:
+// tracks the elements that come and go, and lets waiting rounds go on
+// once insertion has finished
+class CkPersistentReductionListener : public CkArrayListener
+{
+  CkGroupID mgr;
+
+public:
+  CkPersistentReductionListener(CkGroupID mgr_) : CkArrayListener(0), mgr(mgr_) {}
+  CkPersistentReductionListener(CkMigrateMessage* m) : CkArrayListener(m) {}
+  void pup(PUP::er& p)
+  {
+    CkArrayListener::pup(p);
+    p | mgr;
+  }
+  PUPable_decl(CkPersistentReductionListener);
+
+  void ckEndInserting(void);
+  void ckElementCreating(ArrayElement* elt);
+  void ckElementDied(ArrayElement* elt);
+  void ckElementLeaving(ArrayElement* elt);
+  bool ckElementArriving(ArrayElement* elt);
+};
+class CkPersistentReduction : public CBase_CkPersistentReduction
+{
+public:
+  // One contribution per PE per round, e.g. from the branches of a group
+  CkPersistentReduction(int dataSize, int reducer, CkCallback cb, int zcThreshold);
+  // One contribution per local element of boundArray per round
+  CkPersistentReduction(CkArrayID boundArray, int dataSize, int reducer, CkCallback cb,
+                        int zcThreshold);
+  CkPersistentReduction(CkMigrateMessage* m) : CBase_CkPersistentReduction(m) {}
+  ~CkPersistentReduction();
+
+  // Local methods: contribute dataSize bytes of data to the contributor's
+  // next round, for an unbound channel and for an element of the bound array
+  void contribute(const void* data);
+  void contribute(ArrayElement* elt, const void* data);
+
+  // An element of the bound array was created on or migrated to this PE,
+  // or was destroyed or migrated away; for CkPersistentReductionListener
+  void elementJoined(ArrayElement* elt);
+  void elementLeft(ArrayElement* elt);
+  // Go on with the oldest round if it waits for the number of local
+  // contributors
+  void startWaitingRound();
+
+  // Entry methods
+  void listen();
+  void start(int redNo);
+  void recvPartial(int redNo, int fromPe, int size, char* data);
+  void recvPartialZC(int& redNo, int& fromPe, int& size, char*& data,
+                     CkNcpyBufferPost* ncpyPost);
+  void recvPartialZC(int redNo, int fromPe, int size, char* data);
+  void sent(CkDataMsg* m);
+
+private:
+  struct Round
+  {
+    int redNo;
+    int nLocal;                // local contributions folded in so far
+    int nKids;                 // children's results received so far
+    bool filled;               // acc holds data
+    bool nudged;               // missing children were asked to start
+    char* acc;                 // combine buffer
+    CkReductionMsg* msg;       // at the root, the result message acc lies in
+    std::vector<char> heard;   // which children have sent their result
+  };
+
+  CkArrayID boundArray;
+  int dataSize;
+  CkReduction::reducerType reducer;
+  CkReduction::foldFn fold;
+  CkCallback cb;
+  int zcThreshold;
+  CkCallback sentCb;
+
+  int parent;
+  std::vector<int> kids;
+
+  int nextRound;                 // round after the latest local contribution
+  int nextSend;                  // oldest round not yet finished here
+  // Next round of each local element of the bound array, by element ID.
+  // Elements missing here were created before the listener was added and
+  // have not contributed yet, so their next round is 0.
+  std::unordered_map<CmiUInt8, int> elementRounds;
+  std::vector<Round*> rounds;    // rounds in progress
+  std::vector<Round*> spareRounds;
+  std::vector<char*> spareBufs;  // free combine and receive buffers
+  std::vector<char*> allBufs;
+
+  void init(int dataSize, int reducer, const CkCallback& cb, int zcThreshold);
+  int localContributors() const;
+  Round* getRound(int redNo);
+  void addContribution(int redNo, const void* data);
+  char* takeBuffer();
+  void addData(Round* r, char* data, bool owned);
+  void kidDone(Round* r, int fromPe);
+  void tryFinish(Round* r);
+};
+
+#endif
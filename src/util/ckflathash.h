@@ -0,0 +1,437 @@
+/* Open-addressing hash map for the runtime's per-object lookup tables.
+
+   The location manager and array managers look up an element by its
+   64-bit ObjID on every message delivery, and keep one entry per local or
+   recently seen element, which can mean millions of entries per PE.
+   std::unordered_map stores each entry in its own heap node, so every
+   lookup pays a bucket load plus a pointer chase, and every entry carries
+   a node header and allocator overhead.
+
+   ck::FlatHashMap keeps the entries in one flat array, next to an array
+   of one control byte per slot holding 7 bits of the key's hash (or
+   marking the slot empty or erased). A lookup loads the control bytes of
+   16 consecutive slots at once, compares them all with the key's hash
+   byte using SSE2 where available, and only touches the slots whose byte
+   matches, so most lookups cost one cache miss for the control bytes and
+   one for the entry. Groups are probed quadratically. Erased slots are
+   left as tombstones, which are reclaimed when the table is rebuilt.
+
+   The interface is the subset of std::unordered_map the runtime uses,
+   with one difference: inserting may move every entry, so pointers,
+   references and iterators into the map are invalidated by any insert
+   (erasing leaves the other entries in place). Hash values are mixed
+   before use, so identity hashes of structured keys like ObjIDs are fine.
+*/
+#ifndef __CK_FLATHASH_H
+#define __CK_FLATHASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <functional>
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#if defined(__SSE2__) && !defined(_CRAYC)
+#include <emmintrin.h>
+#define CK_FLATHASH_SSE2 1
+#else
+#define CK_FLATHASH_SSE2 0
+#endif
+
+namespace ck {
+
+namespace flathash {
+
+// Control byte values; full slots hold the low 7 bits of the hash (0..127)
+const int8_t kEmpty = -128;
+const int8_t kDeleted = -2;
+// Slots examined at once
+const size_t kGroupWidth = 16;
+
+// Spread the bits of a possibly weak hash (std::hash of an integer is the
+// identity) over the whole word
+inline size_t mix(size_t h)
+{
+  uint64_t x = (uint64_t)h;
+  x ^= x >> 32;
+  x *= 0x9E3779B97F4A7C15ULL;
+  x ^= x >> 29;
+  return (size_t)x;
+}
+
+// A control byte group of all empty slots, used by tables with no storage
+// so that lookups need no special case
+inline const int8_t* emptyGroup()
+{
+  alignas(16) static const int8_t group[kGroupWidth] = {
+      kEmpty, kEmpty, kEmpty, kEmpty, kEmpty, kEmpty, kEmpty, kEmpty,
+      kEmpty, kEmpty, kEmpty, kEmpty, kEmpty, kEmpty, kEmpty, kEmpty};
+  return group;
+}
+
+// The control bytes of kGroupWidth consecutive slots, with bit masks of
+// the slots in a given state
+struct Group
+{
+#if CK_FLATHASH_SSE2
+  __m128i ctrl;
+  explicit Group(const int8_t* p) : ctrl(_mm_loadu_si128((const __m128i*)p)) {}
+  uint32_t match(int8_t h2) const
+  {
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(h2)));
+  }
+  uint32_t matchEmpty() const { return match(kEmpty); }
+  // Empty and deleted are the only values below -1
+  uint32_t matchEmptyOrDeleted() const
+  {
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_set1_epi8(-1), ctrl));
+  }
+#else
+  const int8_t* ctrl;
+  explicit Group(const int8_t* p) : ctrl(p) {}
+  uint32_t match(int8_t h2) const
+  {
+    uint32_t bits = 0;
+    for (size_t i = 0; i < kGroupWidth; i++) bits |= (uint32_t)(ctrl[i] == h2) << i;
+    return bits;
+  }
+  uint32_t matchEmpty() const { return match(kEmpty); }
+  uint32_t matchEmptyOrDeleted() const
+  {
+    uint32_t bits = 0;
+    for (size_t i = 0; i < kGroupWidth; i++) bits |= (uint32_t)(ctrl[i] < -1) << i;
+    return bits;
+  }
+#endif
+};
+
+inline int lowestBit(uint32_t bits)
+{
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_ctz(bits);
+#else
+  int i = 0;
+  while (!(bits & 1))
+  {
+    bits >>= 1;
+    i++;
+  }
+  return i;
+#endif
+}
+
+}  // namespace flathash
+
+template <class K, class V, class Hash = std::hash<K>, class Eq = std::equal_to<K> >
+class FlatHashMap
+{
+public:
+  typedef K key_type;
+  typedef V mapped_type;
+  typedef std::pair<K, V> value_type;
+  typedef size_t size_type;
+
+private:
+  int8_t* ctrl;        // capacity + kGroupWidth - 1 bytes; the tail mirrors the head
+  value_type* slots;   // capacity entries, constructed where ctrl >= 0
+  size_t capacity_;    // 0 or a power of two of at least kGroupWidth
+  size_t size_;
+  size_t growthLeft;   // Empty slots that may still be filled before a rebuild
+  Hash hasher;
+  Eq keyEq;
+
+  static size_t maxLoad(size_t cap) { return cap - cap / 8; }
+
+  size_t hashOf(const K& key) const { return flathash::mix(hasher(key)); }
+
+  // Set a control byte, and its mirror past the end, which lets a group
+  // be loaded at any slot without wrapping around
+  void setCtrl(size_t i, int8_t c)
+  {
+    ctrl[i] = c;
+    if (i < flathash::kGroupWidth - 1) ctrl[capacity_ + i] = c;
+  }
+
+  size_t findIndex(const K& key) const
+  {
+    size_t h = hashOf(key);
+    int8_t h2 = (int8_t)(h & 0x7f);
+    size_t mask = capacity_ ? capacity_ - 1 : 0;
+    size_t pos = (h >> 7) & mask;
+    for (size_t step = flathash::kGroupWidth;; step += flathash::kGroupWidth)
+    {
+      flathash::Group g(ctrl + pos);
+      for (uint32_t bits = g.match(h2); bits; bits &= bits - 1)
+      {
+        size_t i = (pos + flathash::lowestBit(bits)) & mask;
+        if (keyEq(slots[i].first, key)) return i;
+      }
+      if (g.matchEmpty()) return capacity_;
+      pos = (pos + step) & mask;
+    }
+  }
+
+  // First empty or deleted slot on the probe sequence of hash h
+  size_t findFree(size_t h) const
+  {
+    size_t mask = capacity_ - 1;
+    size_t pos = (h >> 7) & mask;
+    for (size_t step = flathash::kGroupWidth;; step += flathash::kGroupWidth)
+    {
+      uint32_t bits = flathash::Group(ctrl + pos).matchEmptyOrDeleted();
+      if (bits) return (pos + flathash::lowestBit(bits)) & mask;
+      pos = (pos + step) & mask;
+    }
+  }
+
+  void allocate(size_t cap)
+  {
+    capacity_ = cap;
+    size_t nctrl = cap + flathash::kGroupWidth - 1;
+    ctrl = (int8_t*)malloc(nctrl);
+    slots = (value_type*)malloc(cap * sizeof(value_type));
+    if (ctrl == NULL || slots == NULL) throw std::bad_alloc();
+    memset(ctrl, (unsigned char)flathash::kEmpty, nctrl);
+    growthLeft = maxLoad(cap) - size_;
+  }
+
+  void release()
+  {
+    if (capacity_ == 0) return;
+    for (size_t i = 0; i < capacity_; i++)
+      if (ctrl[i] >= 0) slots[i].~value_type();
+    free(ctrl);
+    free(slots);
+  }
+
+  void resetEmpty()
+  {
+    ctrl = const_cast<int8_t*>(flathash::emptyGroup());
+    slots = NULL;
+    capacity_ = size_ = growthLeft = 0;
+  }
+
+  // Move every entry into a table of newCap slots, dropping tombstones
+  void rehash(size_t newCap)
+  {
+    int8_t* oldCtrl = ctrl;
+    value_type* oldSlots = slots;
+    size_t oldCap = capacity_;
+    allocate(newCap);
+    for (size_t i = 0; i < oldCap; i++)
+    {
+      if (oldCtrl[i] < 0) continue;
+      size_t h = hashOf(oldSlots[i].first);
+      size_t j = findFree(h);
+      setCtrl(j, (int8_t)(h & 0x7f));
+      new (&slots[j]) value_type(std::move(oldSlots[i]));
+      oldSlots[i].~value_type();
+    }
+    if (oldCap)
+    {
+      free(oldCtrl);
+      free(oldSlots);
+    }
+  }
+
+  // Make room for one more entry, growing only if tombstones do not
+  // account for most of the load
+  void reserveOne()
+  {
+    if (growthLeft > 0) return;
+    if (capacity_ == 0)
+      rehash(flathash::kGroupWidth);
+    else if (size_ * 2 < maxLoad(capacity_))
+      rehash(capacity_);
+    else
+      rehash(capacity_ * 2);
+  }
+
+  // Place a new entry for key, known to be absent; returns its slot
+  template <class... Args>
+  size_t insertNew(const K& key, Args&&... args)
+  {
+    reserveOne();
+    size_t h = hashOf(key);
+    size_t i = findFree(h);
+    if (ctrl[i] == flathash::kEmpty) growthLeft--;
+    new (&slots[i]) value_type(std::piecewise_construct, std::forward_as_tuple(key),
+                               std::forward_as_tuple(std::forward<Args>(args)...));
+    setCtrl(i, (int8_t)(h & 0x7f));
+    size_++;
+    return i;
+  }
+
+public:
+  template <bool IsConst>
+  class iter
+  {
+    friend class FlatHashMap;
+    typedef typename std::conditional<IsConst, const value_type, value_type>::type elem;
+    const int8_t* ctrl;
+    elem* slot;
+    elem* end;
+
+    iter(const int8_t* c, elem* s, elem* e) : ctrl(c), slot(s), end(e) {}
+    void skipFree()
+    {
+      while (slot != end && *ctrl < 0)
+      {
+        ctrl++;
+        slot++;
+      }
+    }
+
+  public:
+    iter() : ctrl(NULL), slot(NULL), end(NULL) {}
+    // iterator converts to const_iterator
+    template <bool C, class = typename std::enable_if<IsConst && !C>::type>
+    iter(const iter<C>& o) : ctrl(o.ctrl), slot(o.slot), end(o.end) {}
+
+    elem& operator*() const { return *slot; }
+    elem* operator->() const { return slot; }
+    iter& operator++()
+    {
+      ctrl++;
+      slot++;
+      skipFree();
+      return *this;
+    }
+    iter operator++(int)
+    {
+      iter old = *this;
+      ++*this;
+      return old;
+    }
+    template <bool C>
+    bool operator==(const iter<C>& o) const { return slot == o.slot; }
+    template <bool C>
+    bool operator!=(const iter<C>& o) const { return slot != o.slot; }
+
+    template <bool C>
+    friend class iter;
+  };
+  typedef iter<false> iterator;
+  typedef iter<true> const_iterator;
+
+  FlatHashMap() { resetEmpty(); }
+  explicit FlatHashMap(size_t n) { resetEmpty(); reserve(n); }
+  FlatHashMap(const FlatHashMap& o) : hasher(o.hasher), keyEq(o.keyEq)
+  {
+    resetEmpty();
+    reserve(o.size_);
+    for (const value_type& e : o) insertNew(e.first, e.second);
+  }
+  FlatHashMap(FlatHashMap&& o) noexcept
+      : ctrl(o.ctrl), slots(o.slots), capacity_(o.capacity_), size_(o.size_),
+        growthLeft(o.growthLeft), hasher(o.hasher), keyEq(o.keyEq)
+  {
+    o.resetEmpty();
+  }
+  FlatHashMap& operator=(FlatHashMap o)
+  {
+    std::swap(ctrl, o.ctrl);
+    std::swap(slots, o.slots);
+    std::swap(capacity_, o.capacity_);
+    std::swap(size_, o.size_);
+    std::swap(growthLeft, o.growthLeft);
+    return *this;
+  }
+  ~FlatHashMap() { release(); }
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  size_t capacity() const { return capacity_; }
+  // Bytes of storage held by the table itself
+  size_t memoryUsage() const
+  {
+    return capacity_ ? capacity_ * (sizeof(value_type) + 1) + flathash::kGroupWidth - 1 : 0;
+  }
+
+  iterator begin()
+  {
+    iterator it(ctrl, slots, slots + capacity_);
+    it.skipFree();
+    return it;
+  }
+  iterator end() { return iterator(NULL, slots + capacity_, slots + capacity_); }
+  const_iterator begin() const
+  {
+    const_iterator it(ctrl, slots, slots + capacity_);
+    it.skipFree();
+    return it;
+  }
+  const_iterator end() const
+  {
+    return const_iterator(NULL, slots + capacity_, slots + capacity_);
+  }
+
+  iterator find(const K& key)
+  {
+    size_t i = findIndex(key);
+    return iterator(ctrl + i, slots + i, slots + capacity_);
+  }
+  const_iterator find(const K& key) const
+  {
+    size_t i = findIndex(key);
+    return const_iterator(ctrl + i, slots + i, slots + capacity_);
+  }
+  size_t count(const K& key) const { return findIndex(key) != capacity_; }
+
+  V& operator[](const K& key)
+  {
+    size_t i = findIndex(key);
+    if (i == capacity_) i = insertNew(key);
+    return slots[i].second;
+  }
+
+  template <class... Args>
+  std::pair<iterator, bool> emplace(const K& key, Args&&... args)
+  {
+    size_t i = findIndex(key);
+    bool inserted = (i == capacity_);
+    if (inserted) i = insertNew(key, std::forward<Args>(args)...);
+    return std::make_pair(iterator(ctrl + i, slots + i, slots + capacity_), inserted);
+  }
+  std::pair<iterator, bool> insert(const value_type& v) { return emplace(v.first, v.second); }
+
+  // Erasing does not move other entries; returns the next entry
+  iterator erase(const_iterator pos)
+  {
+    size_t i = pos.slot - slots;
+    slots[i].~value_type();
+    setCtrl(i, flathash::kDeleted);
+    size_--;
+    iterator next(ctrl + i, slots + i, slots + capacity_);
+    return ++next;
+  }
+  iterator erase(iterator pos) { return erase(const_iterator(pos)); }
+  size_t erase(const K& key)
+  {
+    size_t i = findIndex(key);
+    if (i == capacity_) return 0;
+    erase(const_iterator(ctrl + i, slots + i, slots + capacity_));
+    return 1;
+  }
+
+  void clear()
+  {
+    release();
+    resetEmpty();
+  }
+
+  // Make room for n entries without further rebuilds
+  void reserve(size_t n)
+  {
+    size_t cap = flathash::kGroupWidth;
+    while (maxLoad(cap) < n) cap *= 2;
+    if (cap > capacity_) rehash(cap);
+  }
+};
+
+}  // namespace ck
+
+#endif
@@ -28,6 +28,8 @@ void getPETopoTreeEdges(int pe, int rootPE, int *pes, int numpes, unsigned int b
 
 /// C API to ST_RecursivePartition_getTreeInfo (see below)
 void get_topo_tree_nbs(int root, int *parent, int *child_count, int **children);
+void get_topo_tree_nbs_branch(int root, unsigned int bfactor, int *parent, int *child_count,
+                              int **children);
 
 /**
  * partition given PEs into numparts topology-aware partitions.
@@ -95,6 +97,8 @@ class TopoManager;
  * calls don't recalculate the tree.
  */
 CmiSpanningTreeInfo *ST_RecursivePartition_getTreeInfo(int root);
+/// Same, for a tree with the given branching factor instead of CmiSpanningTreeBranch(0)
+CmiSpanningTreeInfo *ST_RecursivePartition_getTreeInfo(int root, unsigned int bfactor);
 
 /**
  * This strategy is phynode aware, and can form a tree of pes or logical nodes.
@@ -75,52 +75,53 @@ extern int yydebug;
     VIRTUAL = 285,
     MIGRATABLE = 286,
     AGGREGATE = 287,
-    CREATEHERE = 288,
-    CREATEHOME = 289,
-    NOKEEP = 290,
-    NOTRACE = 291,
-    APPWORK = 292,
-    VOID = 293,
-    CONST = 294,
-    NOCOPY = 295,
-    NOCOPYPOST = 296,
-    NOCOPYDEVICE = 297,
-    PACKED = 298,
-    VARSIZE = 299,
-    ENTRY = 300,
-    FOR = 301,
-    FORALL = 302,
-    WHILE = 303,
-    WHEN = 304,
-    OVERLAP = 305,
-    SERIAL = 306,
-    IF = 307,
-    ELSE = 308,
-    PYTHON = 309,
-    LOCAL = 310,
-    NAMESPACE = 311,
-    USING = 312,
-    IDENT = 313,
-    NUMBER = 314,
-    LITERAL = 315,
-    CPROGRAM = 316,
-    HASHIF = 317,
-    HASHIFDEF = 318,
-    INT = 319,
-    LONG = 320,
-    SHORT = 321,
-    CHAR = 322,
-    FLOAT = 323,
-    DOUBLE = 324,
-    UNSIGNED = 325,
-    ACCEL = 326,
-    READWRITE = 327,
-    WRITEONLY = 328,
-    ACCELBLOCK = 329,
-    MEMCRITICAL = 330,
-    REDUCTIONTARGET = 331,
-    CASE = 332,
-    TYPENAME = 333
+    COALESCE = 288,
+    CREATEHERE = 289,
+    CREATEHOME = 290,
+    NOKEEP = 291,
+    NOTRACE = 292,
+    APPWORK = 293,
+    VOID = 294,
+    CONST = 295,
+    NOCOPY = 296,
+    NOCOPYPOST = 297,
+    NOCOPYDEVICE = 298,
+    PACKED = 299,
+    VARSIZE = 300,
+    ENTRY = 301,
+    FOR = 302,
+    FORALL = 303,
+    WHILE = 304,
+    WHEN = 305,
+    OVERLAP = 306,
+    SERIAL = 307,
+    IF = 308,
+    ELSE = 309,
+    PYTHON = 310,
+    LOCAL = 311,
+    NAMESPACE = 312,
+    USING = 313,
+    IDENT = 314,
+    NUMBER = 315,
+    LITERAL = 316,
+    CPROGRAM = 317,
+    HASHIF = 318,
+    HASHIFDEF = 319,
+    INT = 320,
+    LONG = 321,
+    SHORT = 322,
+    CHAR = 323,
+    FLOAT = 324,
+    DOUBLE = 325,
+    UNSIGNED = 326,
+    ACCEL = 327,
+    READWRITE = 328,
+    WRITEONLY = 329,
+    ACCELBLOCK = 330,
+    MEMCRITICAL = 331,
+    REDUCTIONTARGET = 332,
+    CASE = 333,
+    TYPENAME = 334
   };
 #endif
 /* Tokens.  */
@@ -154,52 +155,53 @@ extern int yydebug;
 #define VIRTUAL 285
 #define MIGRATABLE 286
 #define AGGREGATE 287
-#define CREATEHERE 288
-#define CREATEHOME 289
-#define NOKEEP 290
-#define NOTRACE 291
-#define APPWORK 292
-#define VOID 293
-#define CONST 294
-#define NOCOPY 295
-#define NOCOPYPOST 296
-#define NOCOPYDEVICE 297
-#define PACKED 298
-#define VARSIZE 299
-#define ENTRY 300
-#define FOR 301
-#define FORALL 302
-#define WHILE 303
-#define WHEN 304
-#define OVERLAP 305
-#define SERIAL 306
-#define IF 307
-#define ELSE 308
-#define PYTHON 309
-#define LOCAL 310
-#define NAMESPACE 311
-#define USING 312
-#define IDENT 313
-#define NUMBER 314
-#define LITERAL 315
-#define CPROGRAM 316
-#define HASHIF 317
-#define HASHIFDEF 318
-#define INT 319
-#define LONG 320
-#define SHORT 321
-#define CHAR 322
-#define FLOAT 323
-#define DOUBLE 324
-#define UNSIGNED 325
-#define ACCEL 326
-#define READWRITE 327
-#define WRITEONLY 328
-#define ACCELBLOCK 329
-#define MEMCRITICAL 330
-#define REDUCTIONTARGET 331
-#define CASE 332
-#define TYPENAME 333
+#define COALESCE 288
+#define CREATEHERE 289
+#define CREATEHOME 290
+#define NOKEEP 291
+#define NOTRACE 292
+#define APPWORK 293
+#define VOID 294
+#define CONST 295
+#define NOCOPY 296
+#define NOCOPYPOST 297
+#define NOCOPYDEVICE 298
+#define PACKED 299
+#define VARSIZE 300
+#define ENTRY 301
+#define FOR 302
+#define FORALL 303
+#define WHILE 304
+#define WHEN 305
+#define OVERLAP 306
+#define SERIAL 307
+#define IF 308
+#define ELSE 309
+#define PYTHON 310
+#define LOCAL 311
+#define NAMESPACE 312
+#define USING 313
+#define IDENT 314
+#define NUMBER 315
+#define LITERAL 316
+#define CPROGRAM 317
+#define HASHIF 318
+#define HASHIFDEF 319
+#define INT 320
+#define LONG 321
+#define SHORT 322
+#define CHAR 323
+#define FLOAT 324
+#define DOUBLE 325
+#define UNSIGNED 326
+#define ACCEL 327
+#define READWRITE 328
+#define WRITEONLY 329
+#define ACCELBLOCK 330
+#define MEMCRITICAL 331
+#define REDUCTIONTARGET 332
+#define CASE 333
+#define TYPENAME 334
 
 /* Value type.  */
 #if ! defined YYSTYPE && ! defined YYSTYPE_IS_DECLARED
@@ -252,7 +254,7 @@ union YYSTYPE
   XStr* xstrptr;
   AccelBlock* accelBlock;
 
-#line 256 "y.tab.h" /* yacc.c:1909  */
+#line 258 "y.tab.h" /* yacc.c:1909  */
 };
 
 typedef union YYSTYPE YYSTYPE;
@@ -114,6 +114,7 @@ void ReservedWord(int token, int fCol, int lCol);
 %token THREADED
 %token TEMPLATE
 %token WHENIDLE SYNC IGET EXCLUSIVE IMMEDIATE SKIPSCHED INLINE VIRTUAL MIGRATABLE AGGREGATE
+%token COALESCE
 %token CREATEHERE CREATEHOME NOKEEP NOTRACE APPWORK
 %token VOID
 %token CONST
@@ -233,6 +234,9 @@ OptSemiColon	: /* Empty */
 // Commented reserved words introduce parsing conflicts, so they're currently not handled
 Name		: IDENT
 		{ $$ = $1; }
+		/* coalesce only has a meaning as an entry attribute */
+		| COALESCE
+		{ $$ = "coalesce"; }
 		| MODULE { ReservedWord(MODULE, @$.first_column, @$.last_column); YYABORT; }
 		| MAINMODULE { ReservedWord(MAINMODULE, @$.first_column, @$.last_column); YYABORT; }
 		| EXTERN { ReservedWord(EXTERN, @$.first_column, @$.last_column); YYABORT; }
@@ -299,6 +303,8 @@ Name		: IDENT
 
 QualName	: IDENT
 		{ $$ = $1; }
+		| COALESCE
+		{ $$ = "coalesce"; }
 		| QualName ':'':' IDENT
 		{
 		  char *tmp = new char[strlen($1)+strlen($4)+3];
@@ -1044,6 +1050,8 @@ EAttrib		: THREADED
 		{
         $$ = SAGGREGATE;
     }
+		| COALESCE
+		{ $$ = SCOALESCE; }
 		| error
 		{
 		  ERROR("invalid entry method attribute",
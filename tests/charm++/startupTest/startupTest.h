@@ -45,7 +45,9 @@ class main : public CBase_main
 {
  public:
   int doneCount;
+  double startTime, phaseStart;
   main(CkArgMsg *msg);
+  void phaseDone(const char *name);
   void createReport(CkReductionMsg *msg);
   void doneReport(CkReductionMsg *msg);
 };